@@ -48,6 +48,18 @@ let package = Package(
                 .interoperabilityMode(.Cxx)
             ]
         ),
+        // Compares the vector channel expansion kernels with the scalar ones, run with `swift run -c release ASTCExpansionBenchmark`
+        .executableTarget(
+            name: "ASTCExpansionBenchmark",
+            dependencies: [
+                .target(name: "astcenc"),
+                .target(name: "ASTCEncoderC")
+            ],
+            cxxSettings: [
+                // For the internal header of the kernels
+                .headerSearchPath("../ASTCEncoderC")
+            ]
+        ),
     ],
     // The lcms2 library was compiled using c17, so set it also here
     cLanguageStandard: .c17,
@@ -26,10 +26,75 @@ public extension ASTCErrorInfo {
 }
 
 
+public extension ASTCCompressionOptions {
+    /// Default encoder settings with the given encoder effort between `0` (fastest) and `100` (exhaustive).
+    init(quality: Float) {
+        self.init()
+        self.quality = quality
+    }
+}
+
+
+private struct ProgressCallbackContext {
+    var progressCallback: @Sendable (Float) -> Void
+    var task: UnsafeCurrentTask?
+}
+
+
+/// Calls `body` with a user info pointer and a progress callback for the C++ interface.
+///
+/// The callback forwards progress to `progressCallback` and asks to stop once the current task is cancelled. Progress arrives on worker threads, where `Task.isCancelled` doesn't know about the calling task, so the task is captured up front.
+private func withProgressCallback<Result>(_ progressCallback: @Sendable (_ progress: Float) -> Void, _ body: (_ userInfo: UnsafeMutableRawPointer, _ callback: ASTCEncoderProgressCallback) throws -> Result) rethrows -> Result {
+    return try withoutActuallyEscaping(progressCallback) { escapingClosure in
+        try withUnsafeCurrentTask { task in
+            var callbackContext = ProgressCallbackContext(progressCallback: escapingClosure, task: task)
+            
+            return try withUnsafeMutablePointer(to: &callbackContext) { pointer in
+                try body(UnsafeMutableRawPointer(pointer)) { userInfo, progress in
+                    guard let userInfo else {
+                        return false
+                    }
+                    
+                    let callbackContext = userInfo.assumingMemoryBound(to: ProgressCallbackContext.self)
+                    callbackContext.pointee.progressCallback(progress)
+                    return callbackContext.pointee.task?.isCancelled ?? false
+                }
+            }
+        }
+    }
+}
+
+
+/// Keeps the deallocator of caller-owned image data alive until the C++ image releases the data.
+private final class DataDeallocator {
+    let deallocate: @Sendable (UnsafeMutableRawPointer) -> Void
+    
+    init(_ deallocate: @escaping @Sendable (UnsafeMutableRawPointer) -> Void) {
+        self.deallocate = deallocate
+    }
+    
+    static var releaseCallback: ASTCReleaseCallback {
+        return { userInfo, data in
+            guard let userInfo else {
+                return
+            }
+            
+            let deallocator = Unmanaged<DataDeallocator>.fromOpaque(userInfo).takeRetainedValue()
+            deallocator.deallocate(data)
+        }
+    }
+}
+
+
 public extension ASTCRawImage {
-    static func create(data: UnsafeMutablePointer<CChar>, width: Int, height: Int, numComponents: Int, componentSize: Int, linear: Bool, hdr: Bool) throws(LibASTCError) -> ASTCRawImage {
+    /// Creates an image from a copy of `data`.
+    ///
+    /// - Parameter depth: Number of slices of a 3D image. Slices follow each other in `data`.
+    /// - Parameter bytesPerRow: Distance between rows of `data` in bytes. `0` means tightly packed rows.
+    static func create(data: UnsafeMutablePointer<CChar>, width: Int, height: Int, depth: Int = 1, bytesPerRow: Int = 0, numComponents: Int, componentSize: Int, linear: Bool, hdr: Bool) throws(LibASTCError) -> ASTCRawImage {
         var error = ASTCErrorInfo()
-        let image = ASTCRawImage.__createUnsafe(data, width: width, height: height,
+        let image = ASTCRawImage.__createUnsafe(data, width: width, height: height, depth: depth,
+                                                bytesPerRow: bytesPerRow,
                                                 numComponents: numComponents,
                                                 componentSize: componentSize,
                                                 linear: linear, hdr: hdr,
@@ -43,32 +108,182 @@ public extension ASTCRawImage {
     }
     
     
-    func compress(blockWidth: Int, blockHeight: Int, quality: Float, _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws -> ASTCImage {
-        return try withoutActuallyEscaping(progressCallback) { escapingClosure in
-            struct CallbackContext: Sendable {
-                var progressCallback: @Sendable (Float) -> Void
+    /// Creates a tangent space normal map from a copy of `data`.
+    ///
+    /// The first two components hold X and Y mapped from `-1...1` to `0...1`. Only those are compressed, decompression computes Z from them.
+    static func createNormalMap(data: UnsafeMutablePointer<CChar>, width: Int, height: Int, bytesPerRow: Int = 0, numComponents: Int, componentSize: Int = 1) throws(LibASTCError) -> ASTCRawImage {
+        var error = ASTCErrorInfo()
+        let image = ASTCRawImage.__createNormalMapUnsafe(data, width: width, height: height,
+                                                         bytesPerRow: bytesPerRow,
+                                                         numComponents: numComponents,
+                                                         componentSize: componentSize,
+                                                         error: &error)
+        
+        guard let image else {
+            throw error.error
+        }
+        
+        return image
+    }
+    
+    
+    /// Creates an image that uses `data` directly instead of copying it.
+    ///
+    /// `data` must contain tightly packed 4 component pixels, `numComponents` tells how many of them carry actual image content. `deallocator` is called once the image doesn't need the data anymore.
+    static func create(wrapping data: UnsafeMutableRawPointer, width: Int, height: Int, numComponents: Int = 4, componentSize: Int, linear: Bool, hdr: Bool, deallocator: @escaping @Sendable (_ data: UnsafeMutableRawPointer) -> Void) throws(LibASTCError) -> ASTCRawImage {
+        let releaseUserInfo = Unmanaged.passRetained(DataDeallocator(deallocator))
+        
+        var error = ASTCErrorInfo()
+        let image = ASTCRawImage.__createWithoutCopyUnsafe(data.assumingMemoryBound(to: CChar.self),
+                                                           width: width, height: height,
+                                                           numComponents: numComponents,
+                                                           componentSize: componentSize,
+                                                           linear: linear, hdr: hdr,
+                                                           releaseUserInfo: releaseUserInfo.toOpaque(),
+                                                           releaseCallback: DataDeallocator.releaseCallback,
+                                                           error: &error)
+        
+        guard let image else {
+            // The data stays with the caller if the image could not be created
+            releaseUserInfo.release()
+            throw error.error
+        }
+        
+        return image
+    }
+    
+    
+    /// Compresses the image.
+    ///
+    /// - Parameter blockDepth: Depth of 3D blocks, `1` for 2D blocks.
+    /// - Parameter numThreads: Number of threads to compress the image with. `0` uses all available cores.
+    func compress(blockWidth: Int, blockHeight: Int, blockDepth: Int = 1, quality: Float, numThreads: Int = 0, _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws -> ASTCImage {
+        try compress(blockWidth: blockWidth, blockHeight: blockHeight, blockDepth: blockDepth, options: ASTCCompressionOptions(quality: quality), numThreads: numThreads, progressCallback)
+    }
+    
+    
+    /// Compresses the image with the given encoder settings, such as a ``ASTCCompressionOptions/preset(_:contentClass:)``.
+    ///
+    /// - Parameter blockDepth: Depth of 3D blocks, `1` for 2D blocks.
+    /// - Parameter numThreads: Number of threads to compress the image with. `0` uses all available cores.
+    func compress(blockWidth: Int, blockHeight: Int, blockDepth: Int = 1, options: ASTCCompressionOptions, numThreads: Int = 0, _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws -> ASTCImage {
+        return try withProgressCallback(progressCallback) { userInfo, callback in
+            var error = ASTCErrorInfo()
+            let image = __compressUnsafe(blockWidth: blockWidth,
+                                         blockHeight: blockHeight,
+                                         blockDepth: blockDepth,
+                                         options: options,
+                                         numThreads: numThreads,
+                                         error: &error,
+                                         userInfo: userInfo,
+                                         progressCallback: callback)
+            
+            guard let image else {
+                throw error.error
             }
-            var callbackContext = CallbackContext(progressCallback: escapingClosure)
             
-            return try withUnsafeMutablePointer(to: &callbackContext) { pointer in
+            return image
+        }
+    }
+    
+    
+    /// Computes mipmap levels of the image and compresses all of them in parallel.
+    ///
+    /// - Parameter numLevels: Number of levels including the image itself. `0` creates the full chain down to 1x1 pixels.
+    /// - Parameter numThreads: Number of threads to filter and compress with. `0` uses all available cores.
+    func compressMipmaps(numLevels: Int = 0, filter: ASTCMipmapFilter = .kaiser, blockWidth: Int, blockHeight: Int, quality: Float, numThreads: Int = 0, _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws -> ASTCTexture {
+        try compressMipmaps(numLevels: numLevels, filter: filter, blockWidth: blockWidth, blockHeight: blockHeight, options: ASTCCompressionOptions(quality: quality), numThreads: numThreads, progressCallback)
+    }
+    
+    
+    /// Computes mipmap levels of the image and compresses all of them in parallel with the given encoder settings.
+    ///
+    /// - Parameter numLevels: Number of levels including the image itself. `0` creates the full chain down to 1x1 pixels.
+    /// - Parameter numThreads: Number of threads to filter and compress with. `0` uses all available cores.
+    func compressMipmaps(numLevels: Int = 0, filter: ASTCMipmapFilter = .kaiser, blockWidth: Int, blockHeight: Int, options: ASTCCompressionOptions, numThreads: Int = 0, _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws -> ASTCTexture {
+        return try withProgressCallback(progressCallback) { userInfo, callback in
+            var error = ASTCErrorInfo()
+            let texture = __compressMipmapsUnsafe(numLevels: numLevels,
+                                                  filter: filter,
+                                                  blockWidth: blockWidth,
+                                                  blockHeight: blockHeight,
+                                                  options: options,
+                                                  numThreads: numThreads,
+                                                  error: &error,
+                                                  userInfo: userInfo,
+                                                  progressCallback: callback)
+            
+            guard let texture else {
+                throw error.error
+            }
+            
+            return texture
+        }
+    }
+    
+    
+    /// Compresses the image into an `.astc` file, blocks are written directly into the file.
+    ///
+    /// - Parameter numThreads: Number of threads to compress the image with. `0` uses all available cores.
+    func compress(to url: URL, blockWidth: Int, blockHeight: Int, blockDepth: Int = 1, quality: Float, numThreads: Int = 0, _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws {
+        try compress(to: url, blockWidth: blockWidth, blockHeight: blockHeight, blockDepth: blockDepth, options: ASTCCompressionOptions(quality: quality), numThreads: numThreads, progressCallback)
+    }
+    
+    
+    /// Compresses the image into an `.astc` file with the given encoder settings.
+    ///
+    /// - Parameter numThreads: Number of threads to compress the image with. `0` uses all available cores.
+    func compress(to url: URL, blockWidth: Int, blockHeight: Int, blockDepth: Int = 1, options: ASTCCompressionOptions, numThreads: Int = 0, _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws {
+        try withProgressCallback(progressCallback) { userInfo, callback in
+            try url.withUnsafeFileSystemRepresentation { path in
+                guard let path else {
+                    throw LibASTCError.other("Invalid file path")
+                }
+                
                 var error = ASTCErrorInfo()
-                let image = __compressUnsafe(blockWidth: blockWidth,
+                guard __compressToFileUnsafe(path,
+                                             blockWidth: blockWidth,
                                              blockHeight: blockHeight,
-                                             quality: quality,
+                                             blockDepth: blockDepth,
+                                             options: options,
+                                             numThreads: numThreads,
                                              error: &error,
-                                             userInfo: pointer) { userInfo, progress in
-                    userInfo?.withMemoryRebound(to: CallbackContext.self, capacity: 1) { pointer in
-                        pointer.pointee.progressCallback(progress)
-                    }
-                    
-                    return Task.isCancelled
-                }
-                
-                guard let image else {
+                                             userInfo: userInfo,
+                                             progressCallback: callback) else {
                     throw error.error
                 }
-                
-                return image
+            }
+        }
+    }
+    
+    
+    /// Compresses the image into caller-owned memory.
+    ///
+    /// - Parameter capacity: Size of `buffer` in bytes, at least ``getCompressedDataSize(_:_:_:)`` for the block size.
+    /// - Parameter numThreads: Number of threads to compress the image with. `0` uses all available cores.
+    func compress(into buffer: UnsafeMutableRawPointer, capacity: Int, blockWidth: Int, blockHeight: Int, blockDepth: Int = 1, quality: Float, numThreads: Int = 0, _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws {
+        try compress(into: buffer, capacity: capacity, blockWidth: blockWidth, blockHeight: blockHeight, blockDepth: blockDepth, options: ASTCCompressionOptions(quality: quality), numThreads: numThreads, progressCallback)
+    }
+    
+    
+    /// Compresses the image into caller-owned memory with the given encoder settings.
+    ///
+    /// - Parameter capacity: Size of `buffer` in bytes, at least ``getCompressedDataSize(_:_:_:)`` for the block size.
+    /// - Parameter numThreads: Number of threads to compress the image with. `0` uses all available cores.
+    func compress(into buffer: UnsafeMutableRawPointer, capacity: Int, blockWidth: Int, blockHeight: Int, blockDepth: Int = 1, options: ASTCCompressionOptions, numThreads: Int = 0, _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws {
+        try withProgressCallback(progressCallback) { userInfo, callback in
+            var error = ASTCErrorInfo()
+            guard __compressIntoUnsafe(buffer.assumingMemoryBound(to: CChar.self),
+                                       capacity: capacity,
+                                       blockWidth: blockWidth,
+                                       blockHeight: blockHeight,
+                                       blockDepth: blockDepth,
+                                       options: options,
+                                       numThreads: numThreads,
+                                       error: &error,
+                                       userInfo: userInfo,
+                                       progressCallback: callback) else {
+                throw error.error
             }
         }
     }
@@ -76,9 +291,52 @@ public extension ASTCRawImage {
 
 
 public extension ASTCImage {
-    func decompress() throws -> ASTCRawImage {
+    /// Loads an `.astc` file. The file is mapped into memory instead of being read.
+    ///
+    /// The file doesn't describe the pixel format, so it has to be passed in.
+    static func load(contentsOf url: URL, numComponents: Int = 4, componentSize: Int = 1, linear: Bool = false, hdr: Bool = false) throws(LibASTCError) -> ASTCImage {
+        let image = url.withUnsafeFileSystemRepresentation { path -> Result<ASTCImage, LibASTCError> in
+            guard let path else {
+                return .failure(.other("Invalid file path"))
+            }
+            
+            var error = ASTCErrorInfo()
+            guard let image = ASTCImage.__loadUnsafe(path, numComponents: numComponents, componentSize: componentSize, linear: linear, hdr: hdr, error: &error) else {
+                return .failure(error.error)
+            }
+            
+            return .success(image)
+        }
+        
+        return try image.get()
+    }
+    
+    
+    /// Writes the image as an `.astc` file.
+    func write(to url: URL) throws(LibASTCError) {
+        let result = url.withUnsafeFileSystemRepresentation { path -> Result<Void, LibASTCError> in
+            guard let path else {
+                return .failure(.other("Invalid file path"))
+            }
+            
+            var error = ASTCErrorInfo()
+            guard __writeUnsafe(path, error: &error) else {
+                return .failure(error.error)
+            }
+            
+            return .success(())
+        }
+        
+        try result.get()
+    }
+    
+    
+    /// Decompresses the image.
+    ///
+    /// - Parameter numThreads: Number of threads to decompress the image with. `0` uses all available cores.
+    func decompress(numThreads: Int = 0) throws -> ASTCRawImage {
         var error = ASTCErrorInfo()
-        let rawImage = __decompressUnsafe(error: &error, userInfo: nil, progressCallback: nil)
+        let rawImage = __decompressUnsafe(numThreads: numThreads, error: &error, userInfo: nil, progressCallback: nil)
         
         guard let rawImage else {
             throw error.error
@@ -86,6 +344,345 @@ public extension ASTCImage {
         
         return rawImage
     }
+    
+    
+    /// Decompresses the image into `buffer` as 4 component pixels.
+    ///
+    /// - Parameter bytesPerRow: Distance between rows of `buffer` in bytes. `0` means tightly packed rows.
+    /// - Parameter numThreads: Number of threads to decompress the image with. `0` uses all available cores.
+    func decompress(into buffer: UnsafeMutableRawPointer, bytesPerRow: Int = 0, numThreads: Int = 0) throws(LibASTCError) {
+        var error = ASTCErrorInfo()
+        guard __decompressIntoUnsafe(buffer.assumingMemoryBound(to: CChar.self), bytesPerRow: bytesPerRow, numThreads: numThreads, error: &error, userInfo: nil, progressCallback: nil) else {
+            throw error.error
+        }
+    }
+    
+    
+    /// Decompresses the image into `buffer` converting pixels to the given format on the fly.
+    ///
+    /// - Parameter numComponents: Number of components per output pixel, the first `numComponents` decoded components are kept.
+    /// - Parameter componentSize: `1` for 8 bit unorm, `2` for half float or `4` for float components.
+    /// - Parameter bytesPerRow: Distance between rows of `buffer` in bytes. `0` means tightly packed rows.
+    /// - Parameter numThreads: Number of threads to decompress the image with. `0` uses all available cores.
+    func decompress(into buffer: UnsafeMutableRawPointer, bytesPerRow: Int = 0, numComponents: Int, componentSize: Int, numThreads: Int = 0) throws(LibASTCError) {
+        var error = ASTCErrorInfo()
+        guard __decompressIntoUnsafe(buffer.assumingMemoryBound(to: CChar.self), bytesPerRow: bytesPerRow, numComponents: numComponents, componentSize: componentSize, numThreads: numThreads, error: &error, userInfo: nil, progressCallback: nil) else {
+            throw error.error
+        }
+    }
+    
+    
+    /// Decompresses only the pixels inside `rect` into `buffer`, converting them to the given format on the fly.
+    ///
+    /// - Parameter rect: Region of the image in pixels. The first pixel of the region is written to the start of `buffer`.
+    /// - Parameter bytesPerRow: Distance between rows of `buffer` in bytes. `0` means tightly packed rows.
+    /// - Parameter numThreads: Number of threads to decompress the region with. `0` uses all available cores.
+    func decompress(_ rect: ASTCRect, into buffer: UnsafeMutableRawPointer, bytesPerRow: Int = 0, numComponents: Int = 4, componentSize: Int, numThreads: Int = 0) throws(LibASTCError) {
+        var error = ASTCErrorInfo()
+        guard __decompressRegionIntoUnsafe(rect, buffer: buffer.assumingMemoryBound(to: CChar.self), bytesPerRow: bytesPerRow, numComponents: numComponents, componentSize: componentSize, numThreads: numThreads, error: &error, userInfo: nil, progressCallback: nil) else {
+            throw error.error
+        }
+    }
+    
+    
+    /// Re-encodes the blocks touched by `rects` from `image` and writes them into the compressed data in place.
+    ///
+    /// The caller needs exclusive access to the image, textures holding it see the new blocks as well. Images loaded from a file or a compression cache can't be updated, and block statistics are reset.
+    ///
+    /// - Parameter image: Updated image with the same size and pixel format as this image.
+    /// - Parameter rects: Changed areas of `image` in pixels.
+    /// - Parameter options: Encoder settings this image was compressed with.
+    /// - Parameter numThreads: Number of threads to compress the blocks with. `0` uses all available cores.
+    func update(from image: ASTCRawImage, rects: [ASTCRect], options: ASTCCompressionOptions, numThreads: Int = 0, _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws {
+        try withProgressCallback(progressCallback) { userInfo, callback in
+            var error = ASTCErrorInfo()
+            let success = rects.withUnsafeBufferPointer { rects in
+                guard let baseAddress = rects.baseAddress else {
+                    return true
+                }
+                
+                return __updateUnsafe(from: image,
+                                      rects: baseAddress,
+                                      numRects: rects.count,
+                                      options: options,
+                                      numThreads: numThreads,
+                                      error: &error,
+                                      userInfo: userInfo,
+                                      progressCallback: callback)
+            }
+            guard success else {
+                throw error.error
+            }
+        }
+    }
+}
+
+
+public extension ASTCBatchEncoder {
+    static func create(blockWidth: Int, blockHeight: Int, quality: Float, numThreads: Int = 0) throws(LibASTCError) -> ASTCBatchEncoder {
+        try create(blockWidth: blockWidth, blockHeight: blockHeight, options: ASTCCompressionOptions(quality: quality), numThreads: numThreads)
+    }
+    
+    
+    static func create(blockWidth: Int, blockHeight: Int, options: ASTCCompressionOptions, numThreads: Int = 0) throws(LibASTCError) -> ASTCBatchEncoder {
+        var error = ASTCErrorInfo()
+        let encoder = ASTCBatchEncoder.__createUnsafe(blockWidth: blockWidth,
+                                                      blockHeight: blockHeight,
+                                                      options: options,
+                                                      numThreads: numThreads,
+                                                      error: &error)
+        
+        guard let encoder else {
+            throw error.error
+        }
+        
+        return encoder
+    }
+    
+    
+    /// Compresses all `images` sharing one encoder context.
+    ///
+    /// Throughput of the batch is available through ``encodingTime`` and ``megapixelsPerSecond`` afterwards.
+    func encode(_ images: [ASTCRawImage], _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws -> [ASTCImage] {
+        removeAllImages()
+        for image in images {
+            addImage(image)
+        }
+        
+        return try withProgressCallback(progressCallback) { userInfo, callback in
+            var error = ASTCErrorInfo()
+            guard __encodeUnsafe(error: &error, userInfo: userInfo, progressCallback: callback) else {
+                throw error.error
+            }
+            
+            return try images.indices.map { index in
+                guard let image = __getCompressedImageUnsafe(index) else {
+                    throw LibASTCError.other("Missing compressed image")
+                }
+                
+                return image
+            }
+        }
+    }
+}
+
+
+public extension ASTCCompressionScheduler {
+    static func create(numThreads: Int = 0) -> ASTCCompressionScheduler {
+        ASTCCompressionScheduler.__createUnsafe(numThreads: numThreads)
+    }
+    
+    
+    func addImage(_ image: ASTCRawImage, blockWidth: Int, blockHeight: Int, quality: Float) throws(LibASTCError) {
+        try addImage(image, blockWidth: blockWidth, blockHeight: blockHeight, options: ASTCCompressionOptions(quality: quality))
+    }
+    
+    
+    func addImage(_ image: ASTCRawImage, blockWidth: Int, blockHeight: Int, options: ASTCCompressionOptions) throws(LibASTCError) {
+        var error = ASTCErrorInfo()
+        guard __addImageUnsafe(image, blockWidth: blockWidth, blockHeight: blockHeight, options: options, error: &error) else {
+            throw error.error
+        }
+    }
+    
+    
+    /// Compresses all added images and returns them in the order they were added.
+    func run(_ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws -> [ASTCImage] {
+        return try withProgressCallback(progressCallback) { userInfo, callback in
+            var error = ASTCErrorInfo()
+            guard __runUnsafe(error: &error, userInfo: userInfo, progressCallback: callback) else {
+                throw error.error
+            }
+            
+            return try (0 ..< numberOfImages).map { index in
+                guard let image = __getCompressedImageUnsafe(index) else {
+                    throw LibASTCError.other("Missing compressed image")
+                }
+                
+                return image
+            }
+        }
+    }
+}
+
+
+public extension ASTCTexture {
+    /// Creates an empty texture. Pass `6` as `numFaces` for cube maps.
+    static func create(numLevels: Int = 1, numLayers: Int = 1, numFaces: Int = 1) throws(LibASTCError) -> ASTCTexture {
+        var error = ASTCErrorInfo()
+        guard let texture = ASTCTexture.__createUnsafe(numLevels: numLevels, numLayers: numLayers, numFaces: numFaces, error: &error) else {
+            throw error.error
+        }
+        
+        return texture
+    }
+    
+    
+    /// Loads a KTX2 file. The file is mapped into memory instead of being read.
+    static func load(contentsOf url: URL, numComponents: Int = 4, componentSize: Int = 1) throws(LibASTCError) -> ASTCTexture {
+        let texture = url.withUnsafeFileSystemRepresentation { path -> Result<ASTCTexture, LibASTCError> in
+            guard let path else {
+                return .failure(.other("Invalid file path"))
+            }
+            
+            var error = ASTCErrorInfo()
+            guard let texture = ASTCTexture.__loadUnsafe(path, numComponents: numComponents, componentSize: componentSize, error: &error) else {
+                return .failure(error.error)
+            }
+            
+            return .success(texture)
+        }
+        
+        return try texture.get()
+    }
+    
+    
+    func setImage(_ image: ASTCImage, level: Int = 0, layer: Int = 0, face: Int = 0) throws(LibASTCError) {
+        var error = ASTCErrorInfo()
+        guard __setImageUnsafe(image, level: level, layer: layer, face: face, error: &error) else {
+            throw error.error
+        }
+    }
+    
+    
+    func image(level: Int = 0, layer: Int = 0, face: Int = 0) -> ASTCImage? {
+        __getImageUnsafe(level: level, layer: layer, face: face)
+    }
+    
+    
+    /// Writes the texture as a KTX2 file.
+    func write(to url: URL) throws(LibASTCError) {
+        let result = url.withUnsafeFileSystemRepresentation { path -> Result<Void, LibASTCError> in
+            guard let path else {
+                return .failure(.other("Invalid file path"))
+            }
+            
+            var error = ASTCErrorInfo()
+            guard __writeUnsafe(path, error: &error) else {
+                return .failure(error.error)
+            }
+            
+            return .success(())
+        }
+        
+        try result.get()
+    }
+}
+
+
+public extension ASTCCompressionCache {
+    /// Opens the cache in `directory` and creates the directory if needed.
+    ///
+    /// - Parameter maxSize: Size limit of all entries in bytes. `0` never removes entries.
+    static func create(directory url: URL, maxSize: Int = 0) throws(LibASTCError) -> ASTCCompressionCache {
+        let cache = url.withUnsafeFileSystemRepresentation { path -> Result<ASTCCompressionCache, LibASTCError> in
+            guard let path else {
+                return .failure(.other("Invalid file path"))
+            }
+            
+            var error = ASTCErrorInfo()
+            guard let cache = ASTCCompressionCache.__createUnsafe(path, maxSize: maxSize, error: &error) else {
+                return .failure(error.error)
+            }
+            
+            return .success(cache)
+        }
+        
+        return try cache.get()
+    }
+    
+    
+    /// Returns the cached compressed image or compresses `image` and adds it to the cache.
+    ///
+    /// - Parameter blockDepth: Depth of 3D blocks, `1` for 2D blocks.
+    /// - Parameter numThreads: Number of threads to hash and compress the image with. `0` uses all available cores.
+    func compress(_ image: ASTCRawImage, blockWidth: Int, blockHeight: Int, blockDepth: Int = 1, options: ASTCCompressionOptions, numThreads: Int = 0, _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws -> ASTCImage {
+        return try withProgressCallback(progressCallback) { userInfo, callback in
+            var error = ASTCErrorInfo()
+            let compressedImage = __compressUnsafe(image,
+                                                   blockWidth: blockWidth,
+                                                   blockHeight: blockHeight,
+                                                   blockDepth: blockDepth,
+                                                   options: options,
+                                                   numThreads: numThreads,
+                                                   error: &error,
+                                                   userInfo: userInfo,
+                                                   progressCallback: callback)
+            
+            guard let compressedImage else {
+                throw error.error
+            }
+            
+            return compressedImage
+        }
+    }
+}
+
+
+private struct StreamContext {
+    var readRows: (_ buffer: UnsafeMutablePointer<CChar>, _ bytesPerRow: Int, _ y: Int, _ numRows: Int) -> Bool
+    var writeBlocks: (_ blocks: UnsafeRawBufferPointer, _ blockY: Int, _ numBlockRows: Int) -> Bool
+}
+
+
+public extension ASTCStreamEncoder {
+    /// Creates an encoder for images of `width` x `height` pixels that are read in strips instead of all at once.
+    static func create(width: Int, height: Int, numComponents: Int, componentSize: Int, linear: Bool, hdr: Bool, blockWidth: Int, blockHeight: Int, options: ASTCCompressionOptions, numThreads: Int = 0) throws(LibASTCError) -> ASTCStreamEncoder {
+        var error = ASTCErrorInfo()
+        let encoder = ASTCStreamEncoder.__createUnsafe(width: width, height: height,
+                                                       numComponents: numComponents,
+                                                       componentSize: componentSize,
+                                                       linear: linear, hdr: hdr,
+                                                       blockWidth: blockWidth,
+                                                       blockHeight: blockHeight,
+                                                       options: options,
+                                                       numThreads: numThreads,
+                                                       error: &error)
+        
+        guard let encoder else {
+            throw error.error
+        }
+        
+        return encoder
+    }
+    
+    
+    /// Compresses the image strip by strip.
+    ///
+    /// `readRows` fills `buffer` with `numRows` rows starting at row `y`, `writeBlocks` receives the compressed block rows from top to bottom. Both are called on the calling thread and stop encoding by returning `false`.
+    func encode(readRows: (_ buffer: UnsafeMutablePointer<CChar>, _ bytesPerRow: Int, _ y: Int, _ numRows: Int) -> Bool,
+                writeBlocks: (_ blocks: UnsafeRawBufferPointer, _ blockY: Int, _ numBlockRows: Int) -> Bool,
+                _ progressCallback: @Sendable (_ progress: Float) -> Void = { _ in }) throws {
+        try withoutActuallyEscaping(readRows) { readRows in
+            try withoutActuallyEscaping(writeBlocks) { writeBlocks in
+                var streamContext = StreamContext(readRows: readRows, writeBlocks: writeBlocks)
+                try withUnsafeMutablePointer(to: &streamContext) { streamUserInfo in
+                    try withProgressCallback(progressCallback) { userInfo, callback in
+                        var error = ASTCErrorInfo()
+                        let encoded = __encodeUnsafe(reader: { streamUserInfo, buffer, bytesPerRow, y, numRows in
+                            guard let streamUserInfo else {
+                                return false
+                            }
+                            
+                            let streamContext = streamUserInfo.assumingMemoryBound(to: StreamContext.self)
+                            return streamContext.pointee.readRows(buffer, bytesPerRow, y, numRows)
+                        }, writer: { streamUserInfo, blocks, dataLength, blockY, numBlockRows in
+                            guard let streamUserInfo else {
+                                return false
+                            }
+                            
+                            let streamContext = streamUserInfo.assumingMemoryBound(to: StreamContext.self)
+                            return streamContext.pointee.writeBlocks(UnsafeRawBufferPointer(start: blocks, count: dataLength), blockY, numBlockRows)
+                        }, streamUserInfo: UnsafeMutableRawPointer(streamUserInfo), error: &error, userInfo: userInfo, progressCallback: callback)
+                        
+                        guard encoded else {
+                            throw error.error
+                        }
+                    }
+                }
+            }
+        }
+    }
 }
 
 
@@ -99,12 +696,26 @@ public extension ASTCRawImage {
                 throw LibASTCError.other("No data provider :(")
             }
             
-            //guard let colorSpace = CGColorSpace(name: CGColorSpace.extendedDisplayP3) else {
-            //guard let colorSpace = CGColorSpace(name: CGColorSpace.displayP3) else {
-            guard let colorSpace = CGColorSpace(name: CGColorSpace.sRGB) else {
+            // Half and single precision components are floats and may leave the 0...1 range
+            let floatComponents = componentSize > 1
+            let colorSpaceName: CFString
+            if hdr || linear {
+                colorSpaceName = floatComponents ? CGColorSpace.extendedLinearSRGB : CGColorSpace.linearSRGB
+            }
+            else {
+                colorSpaceName = floatComponents ? CGColorSpace.extendedSRGB : CGColorSpace.sRGB
+            }
+            guard let colorSpace = CGColorSpace(name: colorSpaceName) else {
                 throw LibASTCError.other("No color space :(")
             }
             
+            var bitmapInfo = CGImageAlphaInfo.premultipliedLast.rawValue
+            switch componentSize {
+            case 2: bitmapInfo |= CGBitmapInfo.floatComponents.rawValue | CGBitmapInfo.byteOrder16Little.rawValue
+            case 4: bitmapInfo |= CGBitmapInfo.floatComponents.rawValue | CGBitmapInfo.byteOrder32Little.rawValue
+            default: bitmapInfo |= CGBitmapInfo.byteOrderDefault.rawValue
+            }
+            
             let image = CGImage(
                 width: width,
                 height: height,
@@ -112,7 +723,7 @@ public extension ASTCRawImage {
                 bitsPerPixel: componentSize * 8 * 4,
                 bytesPerRow: width * componentSize * 4,
                 space: colorSpace,
-                bitmapInfo: .init(rawValue: CGImageAlphaInfo.premultipliedLast.rawValue | CGBitmapInfo.byteOrderDefault.rawValue),
+                bitmapInfo: .init(rawValue: bitmapInfo),
                 provider: dataProvider,
                 decode: nil,
                 shouldInterpolate: true,
@@ -0,0 +1,185 @@
+//
+//  ASTCBatchEncoder.cpp
+//  ASTCEncoder
+//
+//  Created by agent on 15.10.26.
+//
+
+#include "ASTCEncoderInternal.hpp"
+#include <chrono>
+
+
+struct ASTCBatchProgress {
+    void* __nullable userInfo;
+    ASTCEncoderProgressCallback __nullable callback;
+    long imageIndex;
+    long numImages;
+};
+
+
+ASTCBatchEncoder::ASTCBatchEncoder(long blockWidth, long blockHeight, const ASTCCompressionOptions& options, long numThreads):
+referenceCounter(1),
+_blockWidth(blockWidth),
+_blockHeight(blockHeight),
+_options(options),
+_numThreads(numThreads),
+_encodingTime(0),
+_numPixels(0),
+_numBlocks(0) {
+    // Done
+}
+
+ASTCBatchEncoder::~ASTCBatchEncoder() {
+    removeAllImages();
+}
+
+
+ASTCBatchEncoder* __nullable ASTCBatchEncoderRetain(ASTCBatchEncoder* __nullable encoder) {
+    if (encoder) {
+        encoder->referenceCounter.fetch_add(1);
+    }
+    return encoder;
+}
+
+void ASTCBatchEncoderRelease(ASTCBatchEncoder* __nullable encoder) {
+    if (encoder && encoder->referenceCounter.fetch_sub(1) <= 1) {
+        delete encoder;
+    }
+}
+
+
+ASTCBatchEncoder* __nullable ASTCBatchEncoder::create(long blockWidth, long blockHeight, float quality, long numThreads, ASTCErrorInfo& error) {
+    return create(blockWidth, blockHeight, ASTCCompressionOptions { .quality = quality }, numThreads, error);
+}
+
+
+ASTCBatchEncoder* __nullable ASTCBatchEncoder::create(long blockWidth, long blockHeight, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error) {
+    // Validate the configuration once, so encoding can't fail because of it later. Block sizes and settings are valid for all images alike
+    astcenc_config config;
+    auto result = initCompressionConfig(astcenc_profile::ASTCENC_PRF_LDR, 4, 0, blockWidth, blockHeight, 1, options, &config);
+    if (result != astcenc_error::ASTCENC_SUCCESS) {
+        error.setErrorMessage("Could not initialise config");
+        return nullptr;
+    }
+    
+    return new ASTCBatchEncoder(blockWidth, blockHeight, options, numThreads);
+}
+
+
+void ASTCBatchEncoder::addImage(ASTCRawImage* __nonnull image) {
+    _images.push_back(ASTCRawImageRetain(image));
+}
+
+
+void ASTCBatchEncoder::removeCompressedImages() {
+    for (auto compressedImage: _compressedImages) {
+        ASTCImageRelease(compressedImage);
+    }
+    _compressedImages.clear();
+}
+
+
+void ASTCBatchEncoder::removeAllImages() {
+    removeCompressedImages();
+    
+    for (auto image: _images) {
+        ASTCRawImageRelease(image);
+    }
+    _images.clear();
+}
+
+
+bool ASTCBatchEncoder::encode(ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    removeCompressedImages();
+    _encodingTime = 0;
+    _numPixels = 0;
+    _numBlocks = 0;
+    
+    if (_images.empty()) {
+        return true;
+    }
+    
+    auto startTime = std::chrono::steady_clock::now();
+    
+    // Contexts are shared by all images of a profile, so size them for the largest image
+    long maxNumBlocks = 0;
+    for (auto image: _images) {
+        auto numBlocks = image->getCompressedDataSize(_blockWidth, _blockHeight) / 16;
+        maxNumBlocks = std::max(maxNumBlocks, numBlocks);
+    }
+    
+    astcenc_context* context = nullptr;
+    astcenc_config contextConfig;
+    auto contextNumThreads = resolveNumThreads(_numThreads, maxNumBlocks);
+    
+    // Report progress of the whole batch instead of individual images
+    ASTCBatchProgress batchProgress = {
+        .userInfo = userInfo,
+        .callback = progressCallback,
+        .imageIndex = 0,
+        .numImages = static_cast<long>(_images.size())
+    };
+    ASTCEncoderProgressCallback batchProgressCallback = [](void* __nullable userInfo, float progress) {
+        auto batchProgress = static_cast<ASTCBatchProgress*>(userInfo);
+        auto totalProgress = (static_cast<float>(batchProgress->imageIndex) * 100.0f + progress) / static_cast<float>(batchProgress->numImages);
+        return batchProgress->callback(batchProgress->userInfo, totalProgress);
+    };
+    
+    _compressedImages.reserve(_images.size());
+    for (auto image: _images) {
+        // Switch the context when the image needs another configuration than the previous one, like for another colour space or number of components
+        astcenc_config config;
+        if (!image->makeCompressionConfig(_blockWidth, _blockHeight, 1, _options, &config)) {
+            error.setErrorMessage("Could not initialise config");
+            removeCompressedImages();
+            releaseContext(context);
+            return false;
+        }
+        
+        if (context == nullptr || !isSameConfig(config, contextConfig)) {
+            releaseContext(context);
+            context = nullptr;
+            
+            auto result = acquireContext(config, contextNumThreads, &context);
+            if (result != astcenc_error::ASTCENC_SUCCESS) {
+                error.setErrorMessage("Could not create context");
+                removeCompressedImages();
+                return false;
+            }
+            contextConfig = config;
+        }
+        
+        auto compressedImage = image->compressWithContext(context, contextConfig, _options, contextNumThreads, _blockWidth, _blockHeight, 1, error,
+                                                          &batchProgress, progressCallback ? batchProgressCallback : nullptr);
+        
+        // Prepare the context for the next image
+        astcenc_compress_reset(context);
+        
+        if (compressedImage == nullptr) {
+            removeCompressedImages();
+            releaseContext(context);
+            return false;
+        }
+        
+        _compressedImages.push_back(compressedImage);
+        _numPixels += image->_width * image->_height * image->_depth;
+        _numBlocks += compressedImage->_numBlocksWidth * compressedImage->_numBlocksHeight * compressedImage->_numBlocksDepth;
+        batchProgress.imageIndex++;
+    }
+    
+    // Clean up
+    releaseContext(context);
+    
+    _encodingTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    
+    return true;
+}
+
+
+ASTCImage* __nullable ASTCBatchEncoder::getCompressedImage(long index) {
+    if (index < 0 || index >= static_cast<long>(_compressedImages.size())) {
+        return nullptr;
+    }
+    
+    return ASTCImageRetain(_compressedImages[index]);
+}
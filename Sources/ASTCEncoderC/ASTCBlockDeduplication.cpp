@@ -0,0 +1,162 @@
+//
+//  ASTCBlockDeduplication.cpp
+//  ASTCEncoder
+//
+//  Created by agent on 16.10.26.
+//
+
+#include "ASTCEncoderInternal.hpp"
+#include <string.h>
+#include <unordered_map>
+
+
+// MARK: - XXH64
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+
+static inline uint64_t rotateLeft(uint64_t value, int count) {
+    return (value << count) | (value >> (64 - count));
+}
+
+
+static inline uint64_t readValue64(const char* __nonnull bytes) {
+    uint64_t value;
+    memcpy(&value, bytes, 8);
+    return value;
+}
+
+
+static inline uint64_t readValue32(const char* __nonnull bytes) {
+    uint32_t value;
+    memcpy(&value, bytes, 4);
+    return value;
+}
+
+
+static inline uint64_t hashRound(uint64_t accumulator, uint64_t input) {
+    accumulator += input * XXH_PRIME64_2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * XXH_PRIME64_1;
+}
+
+
+static inline uint64_t hashMergeRound(uint64_t accumulator, uint64_t value) {
+    accumulator ^= hashRound(0, value);
+    return accumulator * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+
+// The four accumulators are independent of each other, so the CPU works on them in parallel
+uint64_t hashBytes(const char* __nonnull bytes, size_t length) {
+    auto end = bytes + length;
+    uint64_t hash;
+    
+    if (length >= 32) {
+        uint64_t v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = XXH_PRIME64_2;
+        uint64_t v3 = 0;
+        uint64_t v4 = 0 - XXH_PRIME64_1;
+        for (; bytes + 32 <= end; bytes += 32) {
+            v1 = hashRound(v1, readValue64(bytes));
+            v2 = hashRound(v2, readValue64(bytes + 8));
+            v3 = hashRound(v3, readValue64(bytes + 16));
+            v4 = hashRound(v4, readValue64(bytes + 24));
+        }
+        
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = hashMergeRound(hash, v1);
+        hash = hashMergeRound(hash, v2);
+        hash = hashMergeRound(hash, v3);
+        hash = hashMergeRound(hash, v4);
+    }
+    else {
+        hash = XXH_PRIME64_5;
+    }
+    
+    hash += length;
+    
+    for (; bytes + 8 <= end; bytes += 8) {
+        hash ^= hashRound(0, readValue64(bytes));
+        hash = rotateLeft(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    
+    if (bytes + 4 <= end) {
+        hash ^= readValue32(bytes) * XXH_PRIME64_1;
+        hash = rotateLeft(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        bytes += 4;
+    }
+    
+    for (; bytes < end; bytes++) {
+        hash ^= static_cast<unsigned char>(*bytes) * XXH_PRIME64_5;
+        hash = rotateLeft(hash, 11) * XXH_PRIME64_1;
+    }
+    
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+
+// MARK: - Deduplication
+
+void removeDuplicateBlocks(const astcenc_image& image, long blockWidth, long blockHeight, unsigned int numThreads, std::vector<uint32_t>& blockIndices, std::vector<ASTCDuplicateBlock>& duplicateBlocks) {
+    auto pixelSize = 4 * getComponentSize(image.data_type);
+    auto blockBytesPerRow = blockWidth * pixelSize;
+    auto blockSize = static_cast<size_t>(blockBytesPerRow * blockHeight);
+    auto numBlocks = blockIndices.size();
+    
+    // Hash the texels as the encoder sees them, edge blocks included. Blocks are taken in chunks, so threads don't fight over the counter
+    std::vector<uint64_t> hashes(numBlocks);
+    std::atomic<size_t> nextBlock = 0;
+    runOnThreads(numThreads, [&](unsigned int) {
+        std::vector<char> texels(blockSize);
+        size_t firstBlock;
+        while ((firstBlock = nextBlock.fetch_add(64)) < numBlocks) {
+            auto lastBlock = std::min(firstBlock + 64, numBlocks);
+            for (auto i = firstBlock; i < lastBlock; i++) {
+                copyBlock(image, blockWidth, blockHeight, blockIndices[i], texels.data(), blockBytesPerRow);
+                hashes[i] = hashBytes(texels.data(), blockSize);
+            }
+        }
+    });
+    
+    // The first block with some texels is encoded, later ones with the same texels reuse its encoding. Every encoded block stays in the map, so blocks whose hashes collide are still matched against all of them
+    std::unordered_multimap<uint64_t, uint32_t> originalBlocks;
+    originalBlocks.reserve(numBlocks);
+    std::vector<char> texels(blockSize);
+    std::vector<char> originalTexels(blockSize);
+    duplicateBlocks.clear();
+    size_t numRemainingBlocks = 0;
+    for (size_t i = 0; i < numBlocks; i++) {
+        auto blockIndex = blockIndices[i];
+        auto [originalBlock, lastOriginalBlock] = originalBlocks.equal_range(hashes[i]);
+        if (originalBlock != lastOriginalBlock) {
+            copyBlock(image, blockWidth, blockHeight, blockIndex, texels.data(), blockBytesPerRow);
+        }
+        
+        for (; originalBlock != lastOriginalBlock; originalBlock++) {
+            copyBlock(image, blockWidth, blockHeight, originalBlock->second, originalTexels.data(), blockBytesPerRow);
+            if (memcmp(texels.data(), originalTexels.data(), blockSize) == 0) {
+                break;
+            }
+        }
+        
+        if (originalBlock != lastOriginalBlock) {
+            duplicateBlocks.push_back({ blockIndex, originalBlock->second });
+            continue;
+        }
+        
+        originalBlocks.emplace(hashes[i], blockIndex);
+        blockIndices[numRemainingBlocks++] = blockIndex;
+    }
+    blockIndices.resize(numRemainingBlocks);
+}
@@ -0,0 +1,449 @@
+//
+//  ASTCChannelExpansion.cpp
+//  ASTCEncoder
+//
+//  Created by agent on 15.10.26.
+//
+
+#include "ASTCEncoderInternal.hpp"
+#include <string.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ASTC_EXPANSION_X86 1
+#endif
+
+
+// MARK: - Scalar
+
+/// Bytes of the value `1` in the given component size: `255` for 8 bit unorm, `1.0` for half and single floats.
+static void getOneValue(long componentSize, unsigned char* __nonnull one) {
+    switch (componentSize) {
+        case 1: {
+            one[0] = 0xFF;
+            break;
+        }
+        case 2: {
+            uint16_t value = 0x3C00;
+            memcpy(one, &value, 2);
+            break;
+        }
+        default: {
+            float value = 1.0f;
+            memcpy(one, &value, 4);
+            break;
+        }
+    }
+}
+
+
+void expandComponentsScalar(const char* __nonnull src, char* __nonnull dst, long numPixels, long numComponents, long componentSize) {
+    unsigned char one[4];
+    getOneValue(componentSize, one);
+    
+    auto pixelSize = numComponents * componentSize;
+    for (long i = 0; i < numPixels; i++) {
+        memcpy(dst, src, pixelSize);
+        for (auto component = numComponents; component < 4; component++) {
+            memcpy(dst + component * componentSize, one, componentSize);
+        }
+        src += pixelSize;
+        dst += 4 * componentSize;
+    }
+}
+
+
+void packComponentsScalar(const char* __nonnull src, char* __nonnull dst, long numPixels, long numComponents, long componentSize) {
+    auto pixelSize = numComponents * componentSize;
+    for (long i = 0; i < numPixels; i++) {
+        memcpy(dst, src, pixelSize);
+        src += 4 * componentSize;
+        dst += pixelSize;
+    }
+}
+
+
+// MARK: - NEON
+
+#if defined(__ARM_NEON)
+
+/// De-interleaving loads and interleaving stores move whole channels at once, the missing channels are filled with a constant register in the same store.
+static long expandComponentsNEON(const char* __nonnull src, char* __nonnull dst, long numPixels, long numComponents, long componentSize) {
+    long i = 0;
+    
+    if (componentSize == 1) {
+        auto s = reinterpret_cast<const uint8_t*>(src);
+        auto d = reinterpret_cast<uint8_t*>(dst);
+        auto one = vdupq_n_u8(0xFF);
+        for (; i + 16 <= numPixels; i += 16) {
+            uint8x16x4_t pixels;
+            switch (numComponents) {
+                case 1: {
+                    auto grey = vld1q_u8(s + i);
+                    pixels = { grey, one, one, one };
+                    break;
+                }
+                case 2: {
+                    auto greyAlpha = vld2q_u8(s + i * 2);
+                    pixels = { greyAlpha.val[0], greyAlpha.val[1], one, one };
+                    break;
+                }
+                default: {
+                    auto rgb = vld3q_u8(s + i * 3);
+                    pixels = { rgb.val[0], rgb.val[1], rgb.val[2], one };
+                    break;
+                }
+            }
+            vst4q_u8(d + i * 4, pixels);
+        }
+    }
+    else if (componentSize == 2) {
+        auto s = reinterpret_cast<const uint16_t*>(src);
+        auto d = reinterpret_cast<uint16_t*>(dst);
+        auto one = vdupq_n_u16(0x3C00);
+        for (; i + 8 <= numPixels; i += 8) {
+            uint16x8x4_t pixels;
+            switch (numComponents) {
+                case 1: {
+                    auto grey = vld1q_u16(s + i);
+                    pixels = { grey, one, one, one };
+                    break;
+                }
+                case 2: {
+                    auto greyAlpha = vld2q_u16(s + i * 2);
+                    pixels = { greyAlpha.val[0], greyAlpha.val[1], one, one };
+                    break;
+                }
+                default: {
+                    auto rgb = vld3q_u16(s + i * 3);
+                    pixels = { rgb.val[0], rgb.val[1], rgb.val[2], one };
+                    break;
+                }
+            }
+            vst4q_u16(d + i * 4, pixels);
+        }
+    }
+    else {
+        auto s = reinterpret_cast<const float*>(src);
+        auto d = reinterpret_cast<float*>(dst);
+        auto one = vdupq_n_f32(1.0f);
+        for (; i + 4 <= numPixels; i += 4) {
+            float32x4x4_t pixels;
+            switch (numComponents) {
+                case 1: {
+                    auto grey = vld1q_f32(s + i);
+                    pixels = { grey, one, one, one };
+                    break;
+                }
+                case 2: {
+                    auto greyAlpha = vld2q_f32(s + i * 2);
+                    pixels = { greyAlpha.val[0], greyAlpha.val[1], one, one };
+                    break;
+                }
+                default: {
+                    auto rgb = vld3q_f32(s + i * 3);
+                    pixels = { rgb.val[0], rgb.val[1], rgb.val[2], one };
+                    break;
+                }
+            }
+            vst4q_f32(d + i * 4, pixels);
+        }
+    }
+    
+    return i;
+}
+
+
+/// Loads whole 4 component pixels de-interleaved and stores back only the kept channels.
+static long packComponentsNEON(const char* __nonnull src, char* __nonnull dst, long numPixels, long numComponents, long componentSize) {
+    long i = 0;
+    
+    if (componentSize == 1) {
+        auto s = reinterpret_cast<const uint8_t*>(src);
+        auto d = reinterpret_cast<uint8_t*>(dst);
+        for (; i + 16 <= numPixels; i += 16) {
+            auto pixels = vld4q_u8(s + i * 4);
+            switch (numComponents) {
+                case 1: vst1q_u8(d + i, pixels.val[0]); break;
+                case 2: vst2q_u8(d + i * 2, (uint8x16x2_t { pixels.val[0], pixels.val[1] })); break;
+                default: vst3q_u8(d + i * 3, (uint8x16x3_t { pixels.val[0], pixels.val[1], pixels.val[2] })); break;
+            }
+        }
+    }
+    else if (componentSize == 2) {
+        auto s = reinterpret_cast<const uint16_t*>(src);
+        auto d = reinterpret_cast<uint16_t*>(dst);
+        for (; i + 8 <= numPixels; i += 8) {
+            auto pixels = vld4q_u16(s + i * 4);
+            switch (numComponents) {
+                case 1: vst1q_u16(d + i, pixels.val[0]); break;
+                case 2: vst2q_u16(d + i * 2, (uint16x8x2_t { pixels.val[0], pixels.val[1] })); break;
+                default: vst3q_u16(d + i * 3, (uint16x8x3_t { pixels.val[0], pixels.val[1], pixels.val[2] })); break;
+            }
+        }
+    }
+    else {
+        auto s = reinterpret_cast<const float*>(src);
+        auto d = reinterpret_cast<float*>(dst);
+        for (; i + 4 <= numPixels; i += 4) {
+            auto pixels = vld4q_f32(s + i * 4);
+            switch (numComponents) {
+                case 1: vst1q_f32(d + i, pixels.val[0]); break;
+                case 2: vst2q_f32(d + i * 2, (float32x4x2_t { pixels.val[0], pixels.val[1] })); break;
+                default: vst3q_f32(d + i * 3, (float32x4x3_t { pixels.val[0], pixels.val[1], pixels.val[2] })); break;
+            }
+        }
+    }
+    
+    return i;
+}
+
+#endif
+
+
+// MARK: - SSSE3 / AVX2
+
+#if defined(ASTC_EXPANSION_X86)
+
+/// Byte shuffle that spreads the source pixels of one 16 byte output vector, and the bytes of `1` to fill the gaps with.
+///
+/// Shuffle indices with the high bit set produce zero bytes, the fill pattern is then merged in with a bitwise or.
+struct ASTCExpansionPattern {
+    alignas(16) unsigned char shuffle[16];
+    alignas(16) unsigned char fill[16];
+    long pixelsPerVector;
+    long sourceBytesPerVector;
+};
+
+
+static ASTCExpansionPattern makeExpansionPattern(long numComponents, long componentSize) {
+    ASTCExpansionPattern pattern;
+    unsigned char one[4];
+    getOneValue(componentSize, one);
+    
+    auto targetPixelSize = 4 * componentSize;
+    pattern.pixelsPerVector = 16 / targetPixelSize;
+    pattern.sourceBytesPerVector = pattern.pixelsPerVector * numComponents * componentSize;
+    for (long byte = 0; byte < 16; byte++) {
+        auto pixel = byte / targetPixelSize;
+        auto component = (byte % targetPixelSize) / componentSize;
+        auto componentByte = byte % componentSize;
+        if (component < numComponents) {
+            pattern.shuffle[byte] = static_cast<unsigned char>(pixel * numComponents * componentSize + component * componentSize + componentByte);
+            pattern.fill[byte] = 0;
+        }
+        else {
+            pattern.shuffle[byte] = 0x80;
+            pattern.fill[byte] = one[componentByte];
+        }
+    }
+    
+    return pattern;
+}
+
+
+/// Number of source bytes the last vector load may read beyond the pixels it uses.
+static long getLoadOverhang(const ASTCExpansionPattern& pattern) {
+    return 16 - pattern.sourceBytesPerVector;
+}
+
+
+__attribute__((target("ssse3")))
+static long expandComponentsSSSE3(const char* __nonnull src, char* __nonnull dst, long numPixels, const ASTCExpansionPattern& pattern, long componentSize) {
+    auto shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(pattern.shuffle));
+    auto fill = _mm_load_si128(reinterpret_cast<const __m128i*>(pattern.fill));
+    auto sourcePixelSize = pattern.sourceBytesPerVector / pattern.pixelsPerVector;
+    auto targetPixelSize = 4 * componentSize;
+    
+    // Each load reads 16 bytes, stop early enough to not read past the end of the row
+    auto maxSourceBytes = numPixels * sourcePixelSize - getLoadOverhang(pattern);
+    long i = 0;
+    for (; (i + pattern.pixelsPerVector) * sourcePixelSize <= maxSourceBytes; i += pattern.pixelsPerVector) {
+        auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * sourcePixelSize));
+        pixels = _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), fill);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * targetPixelSize), pixels);
+    }
+    
+    return i;
+}
+
+
+/// Same as the SSSE3 kernel with two vectors at once, the byte shuffle works on each 128 bit lane separately.
+__attribute__((target("avx2")))
+static long expandComponentsAVX2(const char* __nonnull src, char* __nonnull dst, long numPixels, const ASTCExpansionPattern& pattern, long componentSize) {
+    auto shuffle = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(pattern.shuffle)));
+    auto fill = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(pattern.fill)));
+    auto sourcePixelSize = pattern.sourceBytesPerVector / pattern.pixelsPerVector;
+    auto targetPixelSize = 4 * componentSize;
+    auto pixelsPerIteration = 2 * pattern.pixelsPerVector;
+    
+    auto maxSourceBytes = numPixels * sourcePixelSize - getLoadOverhang(pattern);
+    long i = 0;
+    for (; (i + pixelsPerIteration) * sourcePixelSize <= maxSourceBytes; i += pixelsPerIteration) {
+        auto low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * sourcePixelSize));
+        auto high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (i + pattern.pixelsPerVector) * sourcePixelSize));
+        auto pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        pixels = _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), fill);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * targetPixelSize), pixels);
+    }
+    
+    return i;
+}
+
+
+/// Byte shuffle that moves the kept channels of one 16 byte vector of 4 component pixels to the front.
+struct ASTCPackingPattern {
+    alignas(16) unsigned char shuffle[16];
+    long pixelsPerVector;
+    long targetBytesPerVector;
+};
+
+
+static ASTCPackingPattern makePackingPattern(long numComponents, long componentSize) {
+    ASTCPackingPattern pattern;
+    
+    auto sourcePixelSize = 4 * componentSize;
+    auto targetPixelSize = numComponents * componentSize;
+    pattern.pixelsPerVector = 16 / sourcePixelSize;
+    pattern.targetBytesPerVector = pattern.pixelsPerVector * targetPixelSize;
+    for (long byte = 0; byte < 16; byte++) {
+        if (byte < pattern.targetBytesPerVector) {
+            auto pixel = byte / targetPixelSize;
+            auto pixelByte = byte % targetPixelSize;
+            pattern.shuffle[byte] = static_cast<unsigned char>(pixel * sourcePixelSize + pixelByte);
+        }
+        else {
+            pattern.shuffle[byte] = 0x80;
+        }
+    }
+    
+    return pattern;
+}
+
+
+/// Each store writes 16 bytes of which only the first `targetBytesPerVector` are kept, the rest is overwritten by the next store. Stops early enough to not write past the end of the row.
+__attribute__((target("ssse3")))
+static long packComponentsSSSE3(const char* __nonnull src, char* __nonnull dst, long numPixels, const ASTCPackingPattern& pattern, long componentSize) {
+    auto shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(pattern.shuffle));
+    auto sourcePixelSize = 4 * componentSize;
+    auto targetPixelSize = pattern.targetBytesPerVector / pattern.pixelsPerVector;
+    
+    auto maxTargetBytes = numPixels * targetPixelSize - (16 - pattern.targetBytesPerVector);
+    long i = 0;
+    for (; (i + pattern.pixelsPerVector) * targetPixelSize <= maxTargetBytes; i += pattern.pixelsPerVector) {
+        auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * sourcePixelSize));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * targetPixelSize), _mm_shuffle_epi8(pixels, shuffle));
+    }
+    
+    return i;
+}
+
+
+__attribute__((target("avx2")))
+static long packComponentsAVX2(const char* __nonnull src, char* __nonnull dst, long numPixels, const ASTCPackingPattern& pattern, long componentSize) {
+    auto shuffle = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(pattern.shuffle)));
+    auto sourcePixelSize = 4 * componentSize;
+    auto targetPixelSize = pattern.targetBytesPerVector / pattern.pixelsPerVector;
+    auto pixelsPerIteration = 2 * pattern.pixelsPerVector;
+    
+    auto maxTargetBytes = numPixels * targetPixelSize - (16 - pattern.targetBytesPerVector);
+    long i = 0;
+    for (; (i + pixelsPerIteration) * targetPixelSize <= maxTargetBytes; i += pixelsPerIteration) {
+        auto pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * sourcePixelSize));
+        pixels = _mm256_shuffle_epi8(pixels, shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * targetPixelSize), _mm256_castsi256_si128(pixels));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + (i + pattern.pixelsPerVector) * targetPixelSize), _mm256_extracti128_si256(pixels, 1));
+    }
+    
+    return i;
+}
+
+
+static const ASTCPackingPattern& getPackingPattern(long numComponents, long componentSize) {
+    static const ASTCPackingPattern patterns[3][3] = {
+        { makePackingPattern(1, 1), makePackingPattern(1, 2), makePackingPattern(1, 4) },
+        { makePackingPattern(2, 1), makePackingPattern(2, 2), makePackingPattern(2, 4) },
+        { makePackingPattern(3, 1), makePackingPattern(3, 2), makePackingPattern(3, 4) },
+    };
+    auto sizeIndex = componentSize == 1 ? 0 : (componentSize == 2 ? 1 : 2);
+    return patterns[numComponents - 1][sizeIndex];
+}
+
+
+static const ASTCExpansionPattern& getExpansionPattern(long numComponents, long componentSize) {
+    static const ASTCExpansionPattern patterns[3][3] = {
+        { makeExpansionPattern(1, 1), makeExpansionPattern(1, 2), makeExpansionPattern(1, 4) },
+        { makeExpansionPattern(2, 1), makeExpansionPattern(2, 2), makeExpansionPattern(2, 4) },
+        { makeExpansionPattern(3, 1), makeExpansionPattern(3, 2), makeExpansionPattern(3, 4) },
+    };
+    auto sizeIndex = componentSize == 1 ? 0 : (componentSize == 2 ? 1 : 2);
+    return patterns[numComponents - 1][sizeIndex];
+}
+
+#endif
+
+
+// MARK: - Dispatch
+
+void expandComponents(const char* __nonnull src, char* __nonnull dst, long numPixels, long numComponents, long componentSize) {
+    if (numComponents == 4) {
+        memcpy(dst, src, numPixels * 4 * componentSize);
+        return;
+    }
+    
+    long numExpandedPixels = 0;
+    
+#if defined(__ARM_NEON)
+    numExpandedPixels = expandComponentsNEON(src, dst, numPixels, numComponents, componentSize);
+#elif defined(ASTC_EXPANSION_X86)
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    static const bool hasSSSE3 = __builtin_cpu_supports("ssse3");
+    auto& pattern = getExpansionPattern(numComponents, componentSize);
+    if (hasAVX2) {
+        numExpandedPixels = expandComponentsAVX2(src, dst, numPixels, pattern, componentSize);
+    }
+    else if (hasSSSE3) {
+        numExpandedPixels = expandComponentsSSSE3(src, dst, numPixels, pattern, componentSize);
+    }
+#endif
+    
+    // Leftover pixels
+    auto sourcePixelSize = numComponents * componentSize;
+    auto targetPixelSize = 4 * componentSize;
+    expandComponentsScalar(src + numExpandedPixels * sourcePixelSize, dst + numExpandedPixels * targetPixelSize,
+                           numPixels - numExpandedPixels, numComponents, componentSize);
+}
+
+
+void packComponents(const char* __nonnull src, char* __nonnull dst, long numPixels, long numComponents, long componentSize) {
+    if (numComponents == 4) {
+        memcpy(dst, src, numPixels * 4 * componentSize);
+        return;
+    }
+    
+    long numPackedPixels = 0;
+    
+#if defined(__ARM_NEON)
+    numPackedPixels = packComponentsNEON(src, dst, numPixels, numComponents, componentSize);
+#elif defined(ASTC_EXPANSION_X86)
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    static const bool hasSSSE3 = __builtin_cpu_supports("ssse3");
+    auto& pattern = getPackingPattern(numComponents, componentSize);
+    if (hasAVX2) {
+        numPackedPixels = packComponentsAVX2(src, dst, numPixels, pattern, componentSize);
+    }
+    else if (hasSSSE3) {
+        numPackedPixels = packComponentsSSSE3(src, dst, numPixels, pattern, componentSize);
+    }
+#endif
+    
+    // Leftover pixels
+    auto sourcePixelSize = 4 * componentSize;
+    auto targetPixelSize = numComponents * componentSize;
+    packComponentsScalar(src + numPackedPixels * sourcePixelSize, dst + numPackedPixels * targetPixelSize,
+                         numPixels - numPackedPixels, numComponents, componentSize);
+}
@@ -0,0 +1,397 @@
+//
+//  ASTCCompressionCache.cpp
+//  ASTCEncoder
+//
+//  Created by agent on 16.10.26.
+//
+
+#include "ASTCEncoderInternal.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mutex>
+#include <algorithm>
+
+
+#define ASTC_CACHE_MAGIC "ASTCCACH"
+// Bump when the entry layout or the encoder output changes, old entries are then ignored
+#define ASTC_CACHE_VERSION 1
+// Blocks start at a fixed offset behind the header
+#define ASTC_CACHE_DATA_OFFSET 256
+#define ASTC_CACHE_EXTENSION ".astccache"
+#define ASTC_CACHE_TEMPORARY_PREFIX ".astccache-"
+// Temporary files older than this in seconds were left behind by a crashed process
+#define ASTC_CACHE_TEMPORARY_LIFETIME 3600
+// Pixels are hashed in chunks of this size on several threads
+#define ASTC_CACHE_HASH_CHUNK_SIZE (1 << 20)
+
+
+/// Everything the compressed blocks depend on.
+///
+/// Only fixed size fields, so the key can be hashed and compared byte by byte. Keys are cleared with `memset` first to zero the padding.
+struct ASTCCacheKey {
+    uint64_t pixelHash;
+    uint64_t width;
+    uint64_t height;
+    uint64_t depth;
+    uint32_t numComponents;
+    uint32_t componentSize;
+    uint32_t linear;
+    uint32_t hdr;
+    uint32_t normalMap;
+    
+    // Encoder configuration
+    uint32_t profile;
+    uint32_t flags;
+    uint32_t blockWidth;
+    uint32_t blockHeight;
+    uint32_t blockDepth;
+    float componentWeights[4];
+    uint32_t alphaScaleRadius;
+    float rgbmScale;
+    uint32_t partitionCountLimit;
+    uint32_t partitionIndexLimits[3];
+    uint32_t blockModeLimit;
+    uint32_t refinementLimit;
+    uint32_t candidateLimit;
+    uint32_t partitioningCandidateLimits[3];
+    float dbLimit;
+    float mseOvershoot;
+    float partitionEarlyOutLimitFactors[2];
+    float twoPlaneEarlyOutLimitCorrelation;
+    uint32_t searchMode0Enable;
+};
+
+
+/// Header of a cache entry, followed by the compressed blocks at ``ASTC_CACHE_DATA_OFFSET``.
+///
+/// Entries are stored in the byte order of the machine, entries written on another architecture don't match the version and are misses.
+struct ASTCCacheEntryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dataOffset;
+    uint64_t dataLength;
+    ASTCCacheKey key;
+    int64_t numConstantBlocks;
+    int64_t numDuplicateBlocks;
+};
+static_assert(sizeof(ASTCCacheEntryHeader) <= ASTC_CACHE_DATA_OFFSET, "Cache entry header doesn't fit in front of the blocks");
+
+
+/// Hashes `length` bytes in chunks on `numThreads` threads and combines the hashes of the chunks.
+static uint64_t hashPixels(const char* __nonnull data, size_t length, long numThreads) {
+    auto numChunks = (length + ASTC_CACHE_HASH_CHUNK_SIZE - 1) / ASTC_CACHE_HASH_CHUNK_SIZE;
+    std::vector<uint64_t> chunkHashes(numChunks);
+    std::atomic<size_t> nextChunk = 0;
+    runOnThreads(resolveNumThreads(numThreads, static_cast<long>(numChunks)), [&](unsigned int) {
+        size_t chunk;
+        while ((chunk = nextChunk.fetch_add(1)) < numChunks) {
+            auto offset = chunk * ASTC_CACHE_HASH_CHUNK_SIZE;
+            chunkHashes[chunk] = hashBytes(data + offset, std::min(static_cast<size_t>(ASTC_CACHE_HASH_CHUNK_SIZE), length - offset));
+        }
+    });
+    
+    return hashBytes(reinterpret_cast<const char*>(chunkHashes.data()), numChunks * sizeof(uint64_t));
+}
+
+
+static void setConfigKey(const astcenc_config& config, ASTCCacheKey& key) {
+    key.profile = static_cast<uint32_t>(config.profile);
+    key.flags = config.flags;
+    key.blockWidth = config.block_x;
+    key.blockHeight = config.block_y;
+    key.blockDepth = config.block_z;
+    key.componentWeights[0] = config.cw_r_weight;
+    key.componentWeights[1] = config.cw_g_weight;
+    key.componentWeights[2] = config.cw_b_weight;
+    key.componentWeights[3] = config.cw_a_weight;
+    key.alphaScaleRadius = config.a_scale_radius;
+    key.rgbmScale = config.rgbm_m_scale;
+    key.partitionCountLimit = config.tune_partition_count_limit;
+    key.partitionIndexLimits[0] = config.tune_2partition_index_limit;
+    key.partitionIndexLimits[1] = config.tune_3partition_index_limit;
+    key.partitionIndexLimits[2] = config.tune_4partition_index_limit;
+    key.blockModeLimit = config.tune_block_mode_limit;
+    key.refinementLimit = config.tune_refinement_limit;
+    key.candidateLimit = config.tune_candidate_limit;
+    key.partitioningCandidateLimits[0] = config.tune_2partitioning_candidate_limit;
+    key.partitioningCandidateLimits[1] = config.tune_3partitioning_candidate_limit;
+    key.partitioningCandidateLimits[2] = config.tune_4partitioning_candidate_limit;
+    key.dbLimit = config.tune_db_limit;
+    key.mseOvershoot = config.tune_mse_overshoot;
+    key.partitionEarlyOutLimitFactors[0] = config.tune_2partition_early_out_limit_factor;
+    key.partitionEarlyOutLimitFactors[1] = config.tune_3partition_early_out_limit_factor;
+    key.twoPlaneEarlyOutLimitCorrelation = config.tune_2plane_early_out_limit_correlation;
+    key.searchMode0Enable = config.tune_search_mode0_enable;
+}
+
+
+ASTCCompressionCache::ASTCCompressionCache(const char* __nonnull directory, long maxSize):
+referenceCounter(1),
+_directory(directory),
+_maxSize(maxSize),
+_numHits(0),
+_numMisses(0) {
+    // Done
+}
+
+ASTCCompressionCache::~ASTCCompressionCache() {
+    // Done
+}
+
+
+ASTCCompressionCache* __nullable ASTCCompressionCacheRetain(ASTCCompressionCache* __nullable cache) {
+    if (cache) {
+        cache->referenceCounter.fetch_add(1);
+    }
+    return cache;
+}
+
+void ASTCCompressionCacheRelease(ASTCCompressionCache* __nullable cache) {
+    if (cache && cache->referenceCounter.fetch_sub(1) <= 1) {
+        delete cache;
+    }
+}
+
+
+ASTCCompressionCache* __nullable ASTCCompressionCache::create(const char* __nonnull directory, long maxSize, ASTCErrorInfo& error) {
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        error.setErrorMessage("Could not create cache directory");
+        return nullptr;
+    }
+    
+    struct stat directoryInfo;
+    if (stat(directory, &directoryInfo) != 0 || !S_ISDIR(directoryInfo.st_mode)) {
+        error.setErrorMessage("Cache path is not a directory");
+        return nullptr;
+    }
+    
+    return new ASTCCompressionCache(directory, std::max(maxSize, 0L));
+}
+
+
+ASTCImage* __nullable ASTCCompressionCache::compress(ASTCRawImage* __nonnull image, long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    // The config covers the profile, block size and every setting derived from the options
+    astcenc_config config;
+    if (!image->makeCompressionConfig(blockWidth, blockHeight, blockDepth, options, &config)) {
+        error.setErrorMessage("Could not initialise config");
+        return nullptr;
+    }
+    
+    ASTCCacheKey key;
+    memset(&key, 0, sizeof(key));
+    key.pixelHash = hashPixels(image->_data, static_cast<size_t>(image->_width * image->_height * image->_depth * 4 * image->_componentSize), numThreads);
+    key.width = static_cast<uint64_t>(image->_width);
+    key.height = static_cast<uint64_t>(image->_height);
+    key.depth = static_cast<uint64_t>(image->_depth);
+    key.numComponents = static_cast<uint32_t>(image->_originalNumComponents);
+    key.componentSize = static_cast<uint32_t>(image->_componentSize);
+    key.linear = image->_linear;
+    key.hdr = image->_hdr;
+    key.normalMap = image->_normalMap;
+    setConfigKey(config, key);
+    
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "%016llx" ASTC_CACHE_EXTENSION, static_cast<unsigned long long>(hashBytes(reinterpret_cast<const char*>(&key), sizeof(key))));
+    auto path = _directory + "/" + fileName;
+    
+    auto compressedImage = loadEntry(path, key, image, blockWidth, blockHeight, blockDepth);
+    if (compressedImage) {
+        _numHits.fetch_add(1);
+        
+        // Nothing to encode
+        ASTCOperation operation(nullptr, userInfo, progressCallback);
+        operation.reportProgress(100);
+        return compressedImage;
+    }
+    
+    _numMisses.fetch_add(1);
+    compressedImage = storeEntry(path, key, image, blockWidth, blockHeight, blockDepth, options, numThreads, error, userInfo, progressCallback);
+    if (compressedImage) {
+        evictEntries();
+    }
+    
+    return compressedImage;
+}
+
+
+ASTCImage* __nullable ASTCCompressionCache::loadEntry(const std::string& path, const ASTCCacheKey& key, ASTCRawImage* __nonnull image, long blockWidth, long blockHeight, long blockDepth) {
+    // Missing and unreadable entries are misses, not errors
+    ASTCErrorInfo mappingError;
+    auto mapping = mapFile(path.c_str(), mappingError);
+    if (mapping == nullptr) {
+        return nullptr;
+    }
+    
+    auto dataLength = static_cast<uint64_t>(image->getCompressedDataSize(blockWidth, blockHeight, blockDepth));
+    ASTCCacheEntryHeader header;
+    if (mapping->size < ASTC_CACHE_DATA_OFFSET + dataLength) {
+        releaseFileMapping(mapping, mapping->data);
+        return nullptr;
+    }
+    
+    memcpy(&header, mapping->data, sizeof(header));
+    if (memcmp(header.magic, ASTC_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != ASTC_CACHE_VERSION ||
+        header.dataOffset != ASTC_CACHE_DATA_OFFSET || header.dataLength != dataLength ||
+        memcmp(&header.key, &key, sizeof(key)) != 0) {
+        releaseFileMapping(mapping, mapping->data);
+        return nullptr;
+    }
+    
+    // Entries are evicted by their modification time, so a hit counts as a use
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    
+    // The image takes over the reference to the mapping
+    auto compressedImage = new ASTCImage(mapping->data + ASTC_CACHE_DATA_OFFSET, image->_width, image->_height, image->_depth, image->_originalNumComponents, image->_componentSize, image->_linear, image->_hdr,
+                                         (image->_width + blockWidth - 1) / blockWidth, (image->_height + blockHeight - 1) / blockHeight, (image->_depth + blockDepth - 1) / blockDepth,
+                                         blockWidth, blockHeight, blockDepth,
+                                         mapping, releaseFileMapping);
+    compressedImage->_normalMap = image->_normalMap;
+    compressedImage->_blockStatistics.numConstantBlocks = header.numConstantBlocks;
+    compressedImage->_blockStatistics.numDuplicateBlocks = header.numDuplicateBlocks;
+    return compressedImage;
+}
+
+
+ASTCImage* __nullable ASTCCompressionCache::storeEntry(const std::string& path, const ASTCCacheKey& key, ASTCRawImage* __nonnull image, long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    auto dataLength = image->getCompressedDataSize(blockWidth, blockHeight, blockDepth);
+    auto fileSize = static_cast<size_t>(ASTC_CACHE_DATA_OFFSET + dataLength);
+    
+    // The entry is written next to its final place and renamed when it's complete
+    auto temporaryPath = _directory + "/" ASTC_CACHE_TEMPORARY_PREFIX "XXXXXX";
+    auto file = mkstemp(temporaryPath.data());
+    if (file < 0) {
+        return image->compress(blockWidth, blockHeight, blockDepth, options, numThreads, error, userInfo, progressCallback);
+    }
+    
+    fchmod(file, 0644);
+    void* mappedData = MAP_FAILED;
+    if (ftruncate(file, static_cast<off_t>(fileSize)) == 0) {
+        mappedData = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    }
+    
+    if (mappedData == MAP_FAILED) {
+        close(file);
+        unlink(temporaryPath.c_str());
+        return image->compress(blockWidth, blockHeight, blockDepth, options, numThreads, error, userInfo, progressCallback);
+    }
+    
+    // The encoder writes blocks directly into the entry's pages
+    auto fileData = static_cast<char*>(mappedData);
+    ASTCBlockStatistics statistics;
+    if (!image->compressInto(fileData + ASTC_CACHE_DATA_OFFSET, dataLength, blockWidth, blockHeight, blockDepth, options, numThreads, statistics, error, userInfo, progressCallback)) {
+        munmap(mappedData, fileSize);
+        close(file);
+        unlink(temporaryPath.c_str());
+        return nullptr;
+    }
+    
+    ASTCCacheEntryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ASTC_CACHE_MAGIC, sizeof(header.magic));
+    header.version = ASTC_CACHE_VERSION;
+    header.dataOffset = ASTC_CACHE_DATA_OFFSET;
+    header.dataLength = static_cast<uint64_t>(dataLength);
+    header.key = key;
+    header.numConstantBlocks = statistics.numConstantBlocks;
+    header.numDuplicateBlocks = statistics.numDuplicateBlocks;
+    memcpy(fileData, &header, sizeof(header));
+    munmap(mappedData, fileSize);
+    
+    // The returned image maps the entry copy-on-write, so changes to the image never reach the cache
+    mappedData = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mappedData == MAP_FAILED) {
+        unlink(temporaryPath.c_str());
+        error.setErrorMessage("Could not map file");
+        return nullptr;
+    }
+    
+    // Entries are replaced atomically, readers see either the old or the new file. If renaming fails the image just isn't cached
+    if (rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        unlink(temporaryPath.c_str());
+    }
+    
+    auto mapping = new ASTCFileMapping(static_cast<char*>(mappedData), fileSize);
+    auto compressedImage = new ASTCImage(mapping->data + ASTC_CACHE_DATA_OFFSET, image->_width, image->_height, image->_depth, image->_originalNumComponents, image->_componentSize, image->_linear, image->_hdr,
+                                         (image->_width + blockWidth - 1) / blockWidth, (image->_height + blockHeight - 1) / blockHeight, (image->_depth + blockDepth - 1) / blockDepth,
+                                         blockWidth, blockHeight, blockDepth,
+                                         mapping, releaseFileMapping);
+    compressedImage->_normalMap = image->_normalMap;
+    compressedImage->_blockStatistics = statistics;
+    return compressedImage;
+}
+
+
+void ASTCCompressionCache::evictEntries() {
+    if (_maxSize <= 0) {
+        return;
+    }
+    
+    // One scan at a time, concurrent scans would remove the same entries
+    static std::mutex evictionMutex;
+    std::lock_guard lock(evictionMutex);
+    
+    auto directory = opendir(_directory.c_str());
+    if (directory == nullptr) {
+        return;
+    }
+    
+    struct Entry {
+        std::string path;
+        long size;
+        time_t lastUse;
+    };
+    std::vector<Entry> entries;
+    long totalSize = 0;
+    auto now = time(nullptr);
+    while (auto item = readdir(directory)) {
+        std::string_view name(item->d_name);
+        auto isEntry = name.ends_with(ASTC_CACHE_EXTENSION);
+        auto isTemporary = name.starts_with(ASTC_CACHE_TEMPORARY_PREFIX);
+        if (!isEntry && !isTemporary) {
+            continue;
+        }
+        
+        auto path = _directory + "/" + std::string(name);
+        struct stat fileInfo;
+        if (stat(path.c_str(), &fileInfo) != 0) {
+            continue;
+        }
+        
+        if (isTemporary) {
+            if (now - fileInfo.st_mtime > ASTC_CACHE_TEMPORARY_LIFETIME) {
+                unlink(path.c_str());
+            }
+            continue;
+        }
+        
+        entries.push_back({ path, static_cast<long>(fileInfo.st_size), fileInfo.st_mtime });
+        totalSize += static_cast<long>(fileInfo.st_size);
+    }
+    closedir(directory);
+    
+    if (totalSize <= _maxSize) {
+        return;
+    }
+    
+    // Images still using removed entries keep their mappings
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.lastUse < b.lastUse;
+    });
+    for (auto& entry: entries) {
+        if (totalSize <= _maxSize) {
+            break;
+        }
+        
+        if (unlink(entry.path.c_str()) == 0) {
+            totalSize -= entry.size;
+        }
+    }
+}
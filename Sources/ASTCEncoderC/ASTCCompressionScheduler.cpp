@@ -0,0 +1,436 @@
+//
+//  ASTCCompressionScheduler.cpp
+//  ASTCEncoder
+//
+//  Created by agent on 15.10.26.
+//
+
+#include "ASTCEncoderInternal.hpp"
+#include <chrono>
+#include <deque>
+#include <mutex>
+
+
+/// Job queue of a single worker. The owner takes jobs from the front, other workers steal from the back.
+struct ASTCWorkerQueue {
+    std::mutex mutex;
+    std::deque<long> jobIndices;
+};
+
+
+/// Shared state of a single ``ASTCCompressionScheduler/run`` call.
+struct ASTCSchedulerRun {
+    void* __nullable userInfo;
+    ASTCEncoderProgressCallback __nullable callback;
+    
+    std::mutex progressMutex;
+    long totalNumBlocks = 0;
+    long completedNumBlocks = 0;
+    
+    std::atomic<bool> cancelled = false;
+    std::atomic<bool> failed = false;
+    std::atomic<long> numStolenJobs = 0;
+    ASTCErrorInfo error;
+    
+    /// Reports the overall progress and returns `true` if the caller asked to stop.
+    bool reportProgress(float progress) {
+        if (callback == nullptr) {
+            return cancelled;
+        }
+        
+        std::lock_guard lock(progressMutex);
+        if (cancelled) {
+            return true;
+        }
+        
+        if (callback(userInfo, progress)) {
+            cancelled = true;
+        }
+        return cancelled;
+    }
+    
+    /// Adds `numBlocks` compressed blocks to the overall progress and returns `true` if the caller asked to stop.
+    bool completeBlocks(long numBlocks) {
+        float progress;
+        {
+            std::lock_guard lock(progressMutex);
+            completedNumBlocks += numBlocks;
+            progress = static_cast<float>(completedNumBlocks) * 100.0f / static_cast<float>(std::max(totalNumBlocks, 1L));
+        }
+        
+        return reportProgress(progress);
+    }
+    
+    void fail(const ASTCErrorInfo& jobError) {
+        std::lock_guard lock(progressMutex);
+        if (!failed) {
+            error = jobError;
+            failed = true;
+        }
+    }
+};
+
+
+/// Progress of the task a worker compresses, counted in blocks of the whole run.
+struct ASTCTaskProgress {
+    ASTCSchedulerRun* __nonnull run;
+    long numBlocks = 0;
+    long numReportedBlocks = 0;
+    
+    void start(long numTaskBlocks) {
+        numBlocks = numTaskBlocks;
+        numReportedBlocks = 0;
+    }
+    
+    /// Adds the blocks that weren't reported while the task was running.
+    void finish() {
+        run->completeBlocks(numBlocks - numReportedBlocks);
+    }
+};
+
+
+/// Forwards the progress of a single task to the whole run, scaled by the blocks of the task. The encoder stops the task as soon as the run is cancelled.
+static bool forwardTaskProgress(void* __nullable userInfo, float progress) {
+    auto taskProgress = static_cast<ASTCTaskProgress*>(userInfo);
+    auto numBlocks = std::clamp(static_cast<long>(static_cast<float>(taskProgress->numBlocks) * progress / 100.0f), taskProgress->numReportedBlocks, taskProgress->numBlocks);
+    auto numNewBlocks = numBlocks - taskProgress->numReportedBlocks;
+    taskProgress->numReportedBlocks = numBlocks;
+    return taskProgress->run->completeBlocks(numNewBlocks);
+}
+
+
+/// Large images are split into slices of whole block rows with at least this many blocks each
+#define ASTC_SCHEDULER_SLICE_BLOCKS 1024
+
+
+/// Unit of work of a worker, a whole small image or a slice of block rows of a large one.
+struct ASTCSchedulerTask {
+    long jobIndex;
+    long numBlocks;
+    
+    // Set for slices of large images
+    bool slice;
+    long z;
+    long blockY;
+    long numBlockRows;
+};
+
+
+/// Blocks of a large image, filled slice by slice by any of the workers.
+struct ASTCSlicedJob {
+    char* __nullable data = nullptr;
+    std::atomic<long> numRemainingSlices = 0;
+    std::atomic<long> numConstantBlocks = 0;
+    std::atomic<long> numDuplicateBlocks = 0;
+};
+
+
+/// Context of a worker. Kept as long as subsequent tasks share the configuration.
+struct ASTCWorkerContext {
+    astcenc_context* __nullable context = nullptr;
+    astcenc_config config;
+};
+
+
+ASTCCompressionScheduler::ASTCCompressionScheduler(long numThreads):
+referenceCounter(1),
+_numThreads(numThreads),
+_largeImageThreshold(ASTC_SCHEDULER_DEFAULT_LARGE_IMAGE_THRESHOLD),
+_encodingTime(0),
+_numStolenJobs(0) {
+    // Done
+}
+
+ASTCCompressionScheduler::~ASTCCompressionScheduler() {
+    removeAllImages();
+}
+
+
+ASTCCompressionScheduler* __nullable ASTCCompressionSchedulerRetain(ASTCCompressionScheduler* __nullable scheduler) {
+    if (scheduler) {
+        scheduler->referenceCounter.fetch_add(1);
+    }
+    return scheduler;
+}
+
+void ASTCCompressionSchedulerRelease(ASTCCompressionScheduler* __nullable scheduler) {
+    if (scheduler && scheduler->referenceCounter.fetch_sub(1) <= 1) {
+        delete scheduler;
+    }
+}
+
+
+ASTCCompressionScheduler* __nonnull ASTCCompressionScheduler::create(long numThreads) {
+    return new ASTCCompressionScheduler(numThreads);
+}
+
+
+bool ASTCCompressionScheduler::addImage(ASTCRawImage* __nonnull image, long blockWidth, long blockHeight, float quality, ASTCErrorInfo& error) {
+    return addImage(image, blockWidth, blockHeight, ASTCCompressionOptions { .quality = quality }, error);
+}
+
+
+bool ASTCCompressionScheduler::addImage(ASTCRawImage* __nonnull image, long blockWidth, long blockHeight, const ASTCCompressionOptions& options, ASTCErrorInfo& error) {
+    // Validate the configuration up front, so a run doesn't fail halfway because of it
+    astcenc_config config;
+    if (!image->makeCompressionConfig(blockWidth, blockHeight, 1, options, &config)) {
+        error.setErrorMessage("Could not initialise config");
+        return false;
+    }
+    
+    auto numBlocks = image->getCompressedDataSize(blockWidth, blockHeight) / 16;
+    _jobs.push_back({ ASTCRawImageRetain(image), blockWidth, blockHeight, options, numBlocks });
+    return true;
+}
+
+
+void ASTCCompressionScheduler::removeCompressedImages() {
+    for (auto compressedImage: _compressedImages) {
+        ASTCImageRelease(compressedImage);
+    }
+    _compressedImages.clear();
+}
+
+
+void ASTCCompressionScheduler::removeAllImages() {
+    removeCompressedImages();
+    
+    for (auto& job: _jobs) {
+        ASTCRawImageRelease(job.image);
+    }
+    _jobs.clear();
+}
+
+
+bool ASTCCompressionScheduler::run(ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    removeCompressedImages();
+    _encodingTime = 0;
+    _numStolenJobs = 0;
+    
+    if (_jobs.empty()) {
+        return true;
+    }
+    
+    auto startTime = std::chrono::steady_clock::now();
+    
+    _compressedImages.resize(_jobs.size(), nullptr);
+    
+    ASTCSchedulerRun run;
+    run.userInfo = userInfo;
+    run.callback = progressCallback;
+    for (auto& job: _jobs) {
+        run.totalNumBlocks += job.numBlocks;
+    }
+    
+    auto numThreads = resolveNumThreads(_numThreads, run.totalNumBlocks);
+    auto taskProgressCallback = progressCallback ? forwardTaskProgress : nullptr;
+    
+    // Small images are compressed on a single worker, large ones are split into slices of block rows that are compressed like small images. Alpha scaling looks across block rows, so large images using it are compressed whole on all threads before the workers start
+    std::vector<ASTCSchedulerTask> tasks;
+    std::vector<long> wholeJobIndices;
+    std::vector<ASTCSlicedJob> slicedJobs(_jobs.size());
+    for (long jobIndex = 0; jobIndex < static_cast<long>(_jobs.size()); jobIndex++) {
+        auto& job = _jobs[jobIndex];
+        
+        astcenc_config config;
+        if (!job.image->makeCompressionConfig(job.blockWidth, job.blockHeight, 1, job.options, &config)) {
+            error.setErrorMessage("Could not initialise config");
+            return false;
+        }
+        
+        if (numThreads == 1 || job.numBlocks < _largeImageThreshold) {
+            tasks.push_back({ .jobIndex = jobIndex, .numBlocks = job.numBlocks, .slice = false, .z = 0, .blockY = 0, .numBlockRows = 0 });
+            continue;
+        }
+        
+        auto alphaScaling = (config.flags & ASTCENC_FLG_USE_ALPHA_WEIGHT) != 0 && config.a_scale_radius > 0;
+        if (alphaScaling) {
+            wholeJobIndices.push_back(jobIndex);
+            continue;
+        }
+        
+        auto numBlocksWidth = (job.image->_width + job.blockWidth - 1) / job.blockWidth;
+        auto numBlocksHeight = (job.image->_height + job.blockHeight - 1) / job.blockHeight;
+        auto numSliceBlockRows = std::clamp((ASTC_SCHEDULER_SLICE_BLOCKS + numBlocksWidth - 1) / numBlocksWidth, 1L, numBlocksHeight);
+        for (long z = 0; z < job.image->_depth; z++) {
+            for (long blockY = 0; blockY < numBlocksHeight; blockY += numSliceBlockRows) {
+                auto numBlockRows = std::min(numSliceBlockRows, numBlocksHeight - blockY);
+                tasks.push_back({ .jobIndex = jobIndex, .numBlocks = numBlocksWidth * numBlockRows, .slice = true, .z = z, .blockY = blockY, .numBlockRows = numBlockRows });
+                slicedJobs[jobIndex].numRemainingSlices++;
+            }
+        }
+        
+        // The encoder writes every block, so the output doesn't need to be cleared
+        slicedJobs[jobIndex].data = new char[job.numBlocks * 16];
+    }
+    
+    ASTCTaskProgress wholeJobProgress = { .run = &run };
+    for (auto jobIndex: wholeJobIndices) {
+        if (run.cancelled || run.failed) {
+            break;
+        }
+        
+        auto& job = _jobs[jobIndex];
+        ASTCErrorInfo jobError;
+        wholeJobProgress.start(job.numBlocks);
+        _compressedImages[jobIndex] = job.image->compress(job.blockWidth, job.blockHeight, 1, job.options, numThreads, jobError, &wholeJobProgress, taskProgressCallback);
+        if (_compressedImages[jobIndex] == nullptr) {
+            if (!run.cancelled) {
+                run.fail(jobError);
+            }
+            break;
+        }
+        
+        wholeJobProgress.finish();
+    }
+    
+    // Deal the largest tasks first round-robin, so the queues start out balanced. Workers that run out of tasks steal the smallest ones of the others
+    std::stable_sort(tasks.begin(), tasks.end(), [](const ASTCSchedulerTask& a, const ASTCSchedulerTask& b) {
+        return a.numBlocks > b.numBlocks;
+    });
+    
+    auto numWorkers = static_cast<unsigned int>(std::min<size_t>(numThreads, tasks.size()));
+    std::vector<ASTCWorkerQueue> queues(numWorkers);
+    for (size_t index = 0; index < tasks.size(); index++) {
+        queues[index % numWorkers].jobIndices.push_back(static_cast<long>(index));
+    }
+    
+    runOnThreads(numWorkers, [&](unsigned int workerIndex) {
+        auto takeTask = [&](long& taskIndex) {
+            // Own queue first
+            {
+                auto& queue = queues[workerIndex];
+                std::lock_guard lock(queue.mutex);
+                if (!queue.jobIndices.empty()) {
+                    taskIndex = queue.jobIndices.front();
+                    queue.jobIndices.pop_front();
+                    return true;
+                }
+            }
+            
+            // Steal from the others
+            for (unsigned int offset = 1; offset < numWorkers; offset++) {
+                auto& queue = queues[(workerIndex + offset) % numWorkers];
+                std::lock_guard lock(queue.mutex);
+                if (!queue.jobIndices.empty()) {
+                    taskIndex = queue.jobIndices.back();
+                    queue.jobIndices.pop_back();
+                    run.numStolenJobs++;
+                    return true;
+                }
+            }
+            
+            return false;
+        };
+        
+        ASTCWorkerContext workerContext;
+        ASTCTaskProgress taskProgress = { .run = &run };
+        long taskIndex = 0;
+        while (!run.cancelled && !run.failed && takeTask(taskIndex)) {
+            auto& task = tasks[taskIndex];
+            auto& job = _jobs[task.jobIndex];
+            
+            // Switch the context if the configuration changed
+            astcenc_config config;
+            if (!job.image->makeCompressionConfig(job.blockWidth, job.blockHeight, 1, job.options, &config)) {
+                ASTCErrorInfo jobError;
+                jobError.setErrorMessage("Could not initialise config");
+                run.fail(jobError);
+                break;
+            }
+            
+            if (workerContext.context == nullptr || !isSameConfig(workerContext.config, config)) {
+                releaseContext(workerContext.context);
+                workerContext = ASTCWorkerContext();
+                
+                auto result = acquireContext(config, 1, &workerContext.context);
+                if (result != astcenc_error::ASTCENC_SUCCESS) {
+                    ASTCErrorInfo jobError;
+                    jobError.setErrorMessage("Could not create context");
+                    run.fail(jobError);
+                    break;
+                }
+                
+                workerContext.config = config;
+            }
+            
+            ASTCErrorInfo jobError;
+            auto compressed = true;
+            taskProgress.start(task.numBlocks);
+            if (task.slice) {
+                // Slices write their blocks straight into the blocks of the whole image
+                auto& slicedJob = slicedJobs[task.jobIndex];
+                auto numBlocksWidth = (job.image->_width + job.blockWidth - 1) / job.blockWidth;
+                auto numBlocksHeight = (job.image->_height + job.blockHeight - 1) / job.blockHeight;
+                auto y = task.blockY * job.blockHeight;
+                auto sliceImage = job.image->createRowView(task.z, y, std::min(task.numBlockRows * job.blockHeight, job.image->_height - y));
+                auto sliceData = slicedJob.data + ((task.z * numBlocksHeight + task.blockY) * numBlocksWidth) * 16;
+                ASTCBlockStatistics statistics;
+                compressed = sliceImage->compressWithContext(workerContext.context, workerContext.config, job.options, 1, job.blockWidth, job.blockHeight, 1, sliceData, task.numBlocks * 16, statistics, jobError, &taskProgress, taskProgressCallback);
+                ASTCRawImageRelease(sliceImage);
+                
+                slicedJob.numConstantBlocks += statistics.numConstantBlocks;
+                slicedJob.numDuplicateBlocks += statistics.numDuplicateBlocks;
+                
+                // The last slice hands the blocks over to the compressed image
+                if (compressed && --slicedJob.numRemainingSlices == 0) {
+                    auto compressedImage = job.image->createCompressedImage(slicedJob.data, job.blockWidth, job.blockHeight, 1);
+                    compressedImage->_blockStatistics.numConstantBlocks = slicedJob.numConstantBlocks;
+                    compressedImage->_blockStatistics.numDuplicateBlocks = slicedJob.numDuplicateBlocks;
+                    slicedJob.data = nullptr;
+                    _compressedImages[task.jobIndex] = compressedImage;
+                }
+            }
+            else {
+                auto compressedImage = job.image->compressWithContext(workerContext.context, workerContext.config, job.options, 1, job.blockWidth, job.blockHeight, 1, jobError, &taskProgress, taskProgressCallback);
+                compressed = compressedImage != nullptr;
+                _compressedImages[task.jobIndex] = compressedImage;
+            }
+            astcenc_compress_reset(workerContext.context);
+            
+            // A cancelled run stops the encoder, which isn't a failure of the task
+            if (!compressed) {
+                if (!run.cancelled) {
+                    run.fail(jobError);
+                }
+                break;
+            }
+            
+            taskProgress.finish();
+        }
+        
+        releaseContext(workerContext.context);
+    });
+    
+    // Blocks of large images that didn't finish
+    for (auto& slicedJob: slicedJobs) {
+        delete [] slicedJob.data;
+    }
+    
+    _numStolenJobs = run.numStolenJobs;
+    
+    if (run.failed) {
+        error = run.error;
+        removeCompressedImages();
+        return false;
+    }
+    
+    if (run.cancelled) {
+        error.setErrorMessage("Task was cancelled");
+        removeCompressedImages();
+        return false;
+    }
+    
+    _encodingTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    
+    return true;
+}
+
+
+ASTCImage* __nullable ASTCCompressionScheduler::getCompressedImage(long index) {
+    if (index < 0 || index >= static_cast<long>(_compressedImages.size())) {
+        return nullptr;
+    }
+    
+    return ASTCImageRetain(_compressedImages[index]);
+}
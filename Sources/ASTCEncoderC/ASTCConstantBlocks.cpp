@@ -0,0 +1,243 @@
+//
+//  ASTCConstantBlocks.cpp
+//  ASTCEncoder
+//
+//  Created by agent on 16.10.26.
+//
+
+#include "ASTCEncoderInternal.hpp"
+#include <string.h>
+#include <math.h>
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// SSE2 is part of every x86_64 CPU, 32 bit builds only use it if the compiler targets it
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define ASTC_CONSTANT_BLOCKS_X86 1
+#endif
+
+
+// MARK: - Scalar
+
+/// Checks whether `numBytes` bytes repeat `pattern`. `numBytes` is a multiple of the pixel size, so every chunk starts with a whole pixel.
+static bool matchesPatternScalar(const char* __nonnull bytes, long numBytes, const unsigned char* __nonnull pattern) {
+    for (long offset = 0; offset < numBytes; offset += 16) {
+        if (memcmp(bytes + offset, pattern, static_cast<size_t>(std::min(16L, numBytes - offset))) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// MARK: - NEON
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+
+static bool matchesPatternNEON(const char* __nonnull bytes, long numBytes, const unsigned char* __nonnull pattern) {
+    auto patternVector = vld1q_u8(pattern);
+    for (long offset = 0; offset < numBytes; offset += 16) {
+        auto equal = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(bytes + offset)), patternVector);
+        if (vminvq_u8(equal) != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
+
+
+// MARK: - SSE2
+
+#if defined(ASTC_CONSTANT_BLOCKS_X86)
+
+static bool matchesPatternSSE2(const char* __nonnull bytes, long numBytes, const unsigned char* __nonnull pattern) {
+    auto patternVector = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+    for (long offset = 0; offset < numBytes; offset += 16) {
+        auto equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + offset)), patternVector);
+        if (_mm_movemask_epi8(equal) != 0xFFFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
+
+
+// MARK: - Dispatch
+
+/// Checks whether `numBytes` bytes of pixels all equal the pixel repeated in the 16 bytes of `pattern`.
+static bool matchesPattern(const char* __nonnull bytes, long numBytes, const unsigned char* __nonnull pattern) {
+    // Whole vectors first, the rest byte by byte
+    auto numVectorBytes = numBytes & ~15L;
+    
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    if (!matchesPatternNEON(bytes, numVectorBytes, pattern)) {
+        return false;
+    }
+#elif defined(ASTC_CONSTANT_BLOCKS_X86)
+    if (!matchesPatternSSE2(bytes, numVectorBytes, pattern)) {
+        return false;
+    }
+#else
+    numVectorBytes = 0;
+#endif
+    
+    return matchesPatternScalar(bytes + numVectorBytes, numBytes - numVectorBytes, pattern);
+}
+
+
+// MARK: - Constant blocks
+
+/// Converts a component of `texel` to the UNORM16 value of a constant colour block, rounded the way astcenc does it.
+static uint16_t getUNorm16Component(const char* __nonnull texel, long component, long componentSize) {
+    if (componentSize == 1) {
+        return static_cast<uint16_t>(static_cast<unsigned char>(texel[component]) * 257);
+    }
+    
+    float value;
+    if (componentSize == 2) {
+        uint16_t halfValue;
+        memcpy(&halfValue, texel + component * 2, 2);
+        value = halfToFloat(halfValue);
+    }
+    else {
+        memcpy(&value, texel + component * 4, 4);
+    }
+    
+    // LDR values are clamped, NaN ends up as 0
+    value = value > 0 ? std::min(value, 1.0f) : 0.0f;
+    return static_cast<uint16_t>(lrintf(value * 65535.0f));
+}
+
+
+/// Writes a void extent block of the colour of `texel` as the encoder sees it through `swizzle`.
+///
+/// The extent covers the whole image, which is what astcenc writes for constant blocks as well.
+static void writeConstantBlock(const char* __nonnull texel, long componentSize, const astcenc_swizzle& swizzle, uint8_t* __nonnull block) {
+    // 2D void extent block mode, LDR colour, reserved bits and all extent coordinates set
+    static const uint8_t header[8] = { 0xFC, 0xFD, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    memcpy(block, header, 8);
+    
+    const astcenc_swz components[4] = { swizzle.r, swizzle.g, swizzle.b, swizzle.a };
+    for (long i = 0; i < 4; i++) {
+        uint16_t value;
+        switch (components[i]) {
+            case astcenc_swz::ASTCENC_SWZ_0:
+                value = 0;
+                break;
+            
+            case astcenc_swz::ASTCENC_SWZ_R:
+            case astcenc_swz::ASTCENC_SWZ_G:
+            case astcenc_swz::ASTCENC_SWZ_B:
+            case astcenc_swz::ASTCENC_SWZ_A:
+                value = getUNorm16Component(texel, static_cast<long>(components[i]), componentSize);
+                break;
+            
+            default:
+                value = 0xFFFF;
+                break;
+        }
+        
+        // Colours are stored as little endian UNORM16 values
+        block[8 + i * 2] = static_cast<uint8_t>(value);
+        block[9 + i * 2] = static_cast<uint8_t>(value >> 8);
+    }
+}
+
+
+void encodeConstantBlocks(const astcenc_image& image, const astcenc_swizzle& swizzle, long blockWidth, long blockHeight, unsigned int numThreads, uint8_t* __nonnull blocks, std::vector<uint32_t>& blockIndices) {
+    auto componentSize = getComponentSize(image.data_type);
+    auto pixelSize = 4 * componentSize;
+    long width = image.dim_x;
+    long height = image.dim_y;
+    auto bytesPerRow = width * pixelSize;
+    auto numBlocksWidth = (width + blockWidth - 1) / blockWidth;
+    auto numBlocksHeight = (height + blockHeight - 1) / blockHeight;
+    auto numBlocks = blockIndices.size();
+    
+    // Blocks are taken in chunks, so threads don't fight over the counter. Every block is checked by one thread only
+    std::vector<uint8_t> constantBlocks(numBlocks);
+    std::atomic<size_t> nextBlock = 0;
+    runOnThreads(numThreads, [&](unsigned int) {
+        size_t firstBlock;
+        while ((firstBlock = nextBlock.fetch_add(64)) < numBlocks) {
+            auto lastBlock = std::min(firstBlock + 64, numBlocks);
+            for (auto i = firstBlock; i < lastBlock; i++) {
+                long blockIndex = blockIndices[i];
+                auto slice = static_cast<const char*>(image.data[blockIndex / (numBlocksWidth * numBlocksHeight)]);
+                auto x = (blockIndex % numBlocksWidth) * blockWidth;
+                auto y = (blockIndex / numBlocksWidth % numBlocksHeight) * blockHeight;
+            
+                // Texels outside of the image repeat the edge, only the ones inside count
+                auto numRows = std::min(blockHeight, height - y);
+                auto numRowBytes = std::min(blockWidth, width - x) * pixelSize;
+                auto firstTexel = slice + y * bytesPerRow + x * pixelSize;
+                
+                unsigned char pattern[16];
+                for (long offset = 0; offset < 16; offset += pixelSize) {
+                    memcpy(pattern + offset, firstTexel, static_cast<size_t>(pixelSize));
+                }
+                
+                auto constant = true;
+                for (long row = 0; row < numRows && constant; row++) {
+                    constant = matchesPattern(firstTexel + row * bytesPerRow, numRowBytes, pattern);
+                }
+                
+                if (constant) {
+                    writeConstantBlock(firstTexel, componentSize, swizzle, blocks + blockIndex * 16);
+                    constantBlocks[i] = 1;
+                }
+            }
+        }
+    });
+    
+    // Keep the order of the remaining blocks
+    size_t numRemainingBlocks = 0;
+    for (size_t i = 0; i < numBlocks; i++) {
+        if (constantBlocks[i] == 0) {
+            blockIndices[numRemainingBlocks++] = blockIndices[i];
+        }
+    }
+    blockIndices.resize(numRemainingBlocks);
+}
+
+
+void copyBlock(const astcenc_image& image, long blockWidth, long blockHeight, long blockIndex, char* __nonnull destination, long destinationBytesPerRow) {
+    auto pixelSize = 4 * getComponentSize(image.data_type);
+    long width = image.dim_x;
+    long height = image.dim_y;
+    auto bytesPerRow = width * pixelSize;
+    auto numBlocksWidth = (width + blockWidth - 1) / blockWidth;
+    auto numBlocksHeight = (height + blockHeight - 1) / blockHeight;
+    
+    auto slice = static_cast<const char*>(image.data[blockIndex / (numBlocksWidth * numBlocksHeight)]);
+    auto x = (blockIndex % numBlocksWidth) * blockWidth;
+    auto y = (blockIndex / numBlocksWidth % numBlocksHeight) * blockHeight;
+    auto numTexels = std::min(blockWidth, width - x);
+    for (long row = 0; row < blockHeight; row++) {
+        // Repeat the edge of the image like astcenc does for blocks that stick out of it
+        auto sourceRow = slice + std::min(y + row, height - 1) * bytesPerRow + x * pixelSize;
+        auto destinationRow = destination + row * destinationBytesPerRow;
+        memcpy(destinationRow, sourceRow, static_cast<size_t>(numTexels * pixelSize));
+        for (long texel = numTexels; texel < blockWidth; texel++) {
+            memcpy(destinationRow + texel * pixelSize, sourceRow + (numTexels - 1) * pixelSize, static_cast<size_t>(pixelSize));
+        }
+    }
+}
+
+
+void packBlocks(const astcenc_image& image, long blockWidth, long blockHeight, const std::vector<uint32_t>& blockIndices, long packedBlocksWidth, char* __nonnull packedData) {
+    auto pixelSize = 4 * getComponentSize(image.data_type);
+    auto packedBytesPerRow = packedBlocksWidth * blockWidth * pixelSize;
+    for (size_t i = 0; i < blockIndices.size(); i++) {
+        auto packedIndex = static_cast<long>(i);
+        auto packedBlock = packedData + (packedIndex / packedBlocksWidth) * blockHeight * packedBytesPerRow + (packedIndex % packedBlocksWidth) * blockWidth * pixelSize;
+        copyBlock(image, blockWidth, blockHeight, blockIndices[i], packedBlock, packedBytesPerRow);
+    }
+}
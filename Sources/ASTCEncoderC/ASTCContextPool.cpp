@@ -0,0 +1,206 @@
+//
+//  ASTCContextPool.cpp
+//  ASTCEncoder
+//
+//  Created by agent on 15.10.26.
+//
+
+#include "ASTCEncoderInternal.hpp"
+#include <mutex>
+#include <list>
+#include <unordered_map>
+
+
+#define ASTC_CONTEXT_POOL_DEFAULT_CAPACITY 8
+
+
+bool isSameConfig(const astcenc_config& a, const astcenc_config& b) {
+    return a.profile == b.profile &&
+        a.flags == b.flags &&
+        a.block_x == b.block_x &&
+        a.block_y == b.block_y &&
+        a.block_z == b.block_z &&
+        a.cw_r_weight == b.cw_r_weight &&
+        a.cw_g_weight == b.cw_g_weight &&
+        a.cw_b_weight == b.cw_b_weight &&
+        a.cw_a_weight == b.cw_a_weight &&
+        a.a_scale_radius == b.a_scale_radius &&
+        a.rgbm_m_scale == b.rgbm_m_scale &&
+        a.tune_partition_count_limit == b.tune_partition_count_limit &&
+        a.tune_2partition_index_limit == b.tune_2partition_index_limit &&
+        a.tune_3partition_index_limit == b.tune_3partition_index_limit &&
+        a.tune_4partition_index_limit == b.tune_4partition_index_limit &&
+        a.tune_block_mode_limit == b.tune_block_mode_limit &&
+        a.tune_refinement_limit == b.tune_refinement_limit &&
+        a.tune_candidate_limit == b.tune_candidate_limit &&
+        a.tune_2partitioning_candidate_limit == b.tune_2partitioning_candidate_limit &&
+        a.tune_3partitioning_candidate_limit == b.tune_3partitioning_candidate_limit &&
+        a.tune_4partitioning_candidate_limit == b.tune_4partitioning_candidate_limit &&
+        a.tune_db_limit == b.tune_db_limit &&
+        a.tune_mse_overshoot == b.tune_mse_overshoot &&
+        a.tune_2partition_early_out_limit_factor == b.tune_2partition_early_out_limit_factor &&
+        a.tune_3partition_early_out_limit_factor == b.tune_3partition_early_out_limit_factor &&
+        a.tune_2plane_early_out_limit_correlation == b.tune_2plane_early_out_limit_correlation &&
+        a.tune_search_mode0_enable == b.tune_search_mode0_enable &&
+        a.progress_callback == b.progress_callback;
+}
+
+
+/// Configuration a pooled context was allocated with.
+struct ASTCContextKey {
+    astcenc_config config;
+    unsigned int numThreads;
+    
+    bool operator == (const ASTCContextKey& other) const {
+        return numThreads == other.numThreads && isSameConfig(config, other.config);
+    }
+};
+
+
+struct ASTCPooledContext {
+    ASTCContextKey key;
+    astcenc_context* __nonnull context;
+};
+
+
+struct ASTCContextPoolState {
+    std::mutex mutex;
+    long capacity = ASTC_CONTEXT_POOL_DEFAULT_CAPACITY;
+    
+    // Idle contexts, the most recently used one comes first
+    std::list<ASTCPooledContext> idleContexts;
+    
+    // Contexts currently in use
+    std::unordered_map<astcenc_context*, ASTCContextKey> leasedContexts;
+    
+    /// Removes least recently used idle contexts until the pool fits into its capacity. Returns them to be freed outside the lock.
+    std::vector<astcenc_context*> trim() {
+        std::vector<astcenc_context*> evicted;
+        while (static_cast<long>(idleContexts.size()) > capacity) {
+            evicted.push_back(idleContexts.back().context);
+            idleContexts.pop_back();
+        }
+        
+        return evicted;
+    }
+};
+
+
+static ASTCContextPoolState& poolState() {
+    // Intentionally leaked, so contexts can still be released during static destruction
+    static auto state = new ASTCContextPoolState();
+    return *state;
+}
+
+
+static void freeContexts(const std::vector<astcenc_context*>& contexts) {
+    for (auto context: contexts) {
+        astcenc_context_free(context);
+    }
+}
+
+
+astcenc_error acquireContext(const astcenc_config& config, unsigned int numThreads, astcenc_context* __nullable * __nonnull context) {
+    auto& pool = poolState();
+    ASTCContextKey key = { config, numThreads };
+    
+    // Reuse a warm context if possible
+    {
+        std::lock_guard lock(pool.mutex);
+        for (auto it = pool.idleContexts.begin(); it != pool.idleContexts.end(); it++) {
+            if (it->key == key) {
+                *context = it->context;
+                pool.idleContexts.erase(it);
+                pool.leasedContexts[*context] = key;
+                return astcenc_error::ASTCENC_SUCCESS;
+            }
+        }
+    }
+    
+    // Allocate a new one otherwise
+    auto result = astcenc_context_alloc(&config, numThreads, context);
+    if (result != astcenc_error::ASTCENC_SUCCESS) {
+        return result;
+    }
+    
+    std::lock_guard lock(pool.mutex);
+    pool.leasedContexts[*context] = key;
+    return astcenc_error::ASTCENC_SUCCESS;
+}
+
+
+void releaseContext(astcenc_context* __nullable context) {
+    if (context == nullptr) {
+        return;
+    }
+    
+    auto& pool = poolState();
+    std::unique_lock lock(pool.mutex);
+    auto leased = pool.leasedContexts.find(context);
+    if (leased == pool.leasedContexts.end()) {
+        // Not a pooled context
+        lock.unlock();
+        astcenc_context_free(context);
+        return;
+    }
+    auto key = leased->second;
+    pool.leasedContexts.erase(leased);
+    lock.unlock();
+    
+    // Prepare the context for the next image
+    if (key.config.flags & ASTCENC_FLG_DECOMPRESS_ONLY) {
+        astcenc_decompress_reset(context);
+    }
+    else {
+        astcenc_compress_reset(context);
+        astcenc_decompress_reset(context);
+    }
+    
+    lock.lock();
+    pool.idleContexts.push_front({ key, context });
+    auto evicted = pool.trim();
+    lock.unlock();
+    
+    freeContexts(evicted);
+}
+
+
+// MARK: - ASTCContextPool
+
+long ASTCContextPool::getCapacity() {
+    auto& pool = poolState();
+    std::lock_guard lock(pool.mutex);
+    return pool.capacity;
+}
+
+
+void ASTCContextPool::setCapacity(long capacity) {
+    auto& pool = poolState();
+    std::unique_lock lock(pool.mutex);
+    pool.capacity = std::max(capacity, 0L);
+    auto evicted = pool.trim();
+    lock.unlock();
+    
+    freeContexts(evicted);
+}
+
+
+long ASTCContextPool::getNumberOfIdleContexts() {
+    auto& pool = poolState();
+    std::lock_guard lock(pool.mutex);
+    return static_cast<long>(pool.idleContexts.size());
+}
+
+
+void ASTCContextPool::purge() {
+    auto& pool = poolState();
+    std::unique_lock lock(pool.mutex);
+    std::vector<astcenc_context*> evicted;
+    for (auto& idleContext: pool.idleContexts) {
+        evicted.push_back(idleContext.context);
+    }
+    pool.idleContexts.clear();
+    lock.unlock();
+    
+    freeContexts(evicted);
+}
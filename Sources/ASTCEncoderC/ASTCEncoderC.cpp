@@ -6,12 +6,15 @@
 //
 
 #define __STDC_LIB_EXT1__ 1
-#include <astcenc.h>
-#include <ASTCEncoderC.hpp>
+#include "ASTCEncoderInternal.hpp"
 #include <stdio.h>
-#include <thread>
 
 #include <string.h>
+#include <numeric>
+
+
+// Remaining blocks are only packed into a separate image if at least one in this many blocks is skipped
+#define ASTC_MIN_SKIPPED_BLOCKS_DIVISOR 4
 
 
 static void copyString(char* __nonnull dst, const char* __nullable src, long maxLen) {
@@ -29,24 +32,31 @@ static void copyString(char* __nonnull dst, const char* __nullable src, long max
 }
 
 
-struct ASTCCallbackContext {
-    astcenc_context* __nullable context;
-    void* __nullable userInfo = nullptr;
-    ASTCEncoderProgressCallback __nullable callback = nullptr;
+thread_local ASTCOperation* __nullable currentOperation = nullptr;
+
+
+void ASTCOperation::reportProgress(float progress) {
+    if (callback == nullptr) {
+        return;
+    }
+    
+    std::lock_guard lock(callbackMutex);
     
-    // Task was cancelled during compression
-    bool cancelled;
+    // Don't process if cancelled
+    if (cancelled) {
+        return;
+    }
     
-    void reset() {
-        context = nullptr;
-        userInfo = nullptr;
-        callback = nullptr;
-        cancelled = false;
+    // Execute callback
+    // TODO: We can also send back image data to see the live preview!
+    auto shouldStop = callback(userInfo, progress);
+    if (shouldStop) {
+        cancelled = true;
+        if (context) {
+            astcenc_compress_cancel(context);
+        }
     }
-};
-
-
-thread_local ASTCCallbackContext callbackContext = ASTCCallbackContext();
+}
 
 
 // MARK: - ASTCErrorInfo
@@ -100,20 +110,29 @@ void ASTCErrorInfo::setErrorMessage(const char* __nullable errorMessage) {
 
 // MARK: - ASTCRawImage
 
-ASTCRawImage::ASTCRawImage(char* __nonnull data, long width, long height, long originalNumComponents, long componentSize, bool linear, bool hdr):
+ASTCRawImage::ASTCRawImage(char* __nonnull data, long width, long height, long depth, long originalNumComponents, long componentSize, bool linear, bool hdr, void* __nullable releaseUserInfo, ASTCReleaseCallback __nullable releaseCallback):
 referenceCounter(1),
 _data(data),
 _width(width),
 _height(height),
+_depth(depth),
 _originalNumComponents(originalNumComponents),
 _componentSize(componentSize),
 _linear(linear),
-_hdr(hdr) {
+_hdr(hdr),
+_normalMap(false),
+_releaseUserInfo(releaseUserInfo),
+_releaseCallback(releaseCallback) {
     // Done
 }
 
 ASTCRawImage::~ASTCRawImage() {
-    delete [] _data;
+    if (_releaseCallback) {
+        _releaseCallback(_releaseUserInfo, _data);
+    }
+    else {
+        delete [] _data;
+    }
 }
 
 
@@ -131,199 +150,699 @@ void ASTCRawImageRelease(ASTCRawImage* __nullable image) {
 }
 
 
-ASTCRawImage* __nullable ASTCRawImage::create(char* __nonnull data, long width, long height, long numComponents, long componentSize, bool linear, bool hdr, ASTCErrorInfo& error) SWIFT_RETURNS_RETAINED {
-    // Validate input data
-    if (data == nullptr) {
-        error.setErrorMessage("Image data not specified");
-        return nullptr;
-    }
-    
+bool validateImageFormat(long width, long height, long numComponents, long componentSize, bool hdr, ASTCErrorInfo& error) {
     if (width < 1) {
         error.setErrorMessage("Invalid width");
-        return nullptr;
+        return false;
     }
     
     if (height < 1) {
         error.setErrorMessage("Invalid height");
-        return nullptr;
+        return false;
     }
     
     if (numComponents < 1 || numComponents > 4) {
         error.setErrorMessage("Unsupported number of components");
-        return nullptr;
+        return false;
     }
     
     if (componentSize != 1 && componentSize != 2 && componentSize != 4) {
         error.setErrorMessage("Unsupported component size");
+        return false;
+    }
+    
+    // HDR values don't fit into 8 bit components, they come as half or single precision floats
+    if (hdr && componentSize == 1) {
+        error.setErrorMessage("HDR images need float components");
+        return false;
+    }
+    
+    return true;
+}
+
+
+static bool validateImageParameters(const char* __nullable data, long width, long height, long numComponents, long componentSize, bool hdr, ASTCErrorInfo& error) {
+    if (data == nullptr) {
+        error.setErrorMessage("Image data not specified");
+        return false;
+    }
+    
+    return validateImageFormat(width, height, numComponents, componentSize, hdr, error);
+}
+
+
+ASTCRawImage* __nullable ASTCRawImage::create(char* __nonnull data, long width, long height, long numComponents, long componentSize, bool linear, bool hdr, ASTCErrorInfo& error) SWIFT_RETURNS_RETAINED {
+    return create(data, width, height, 0, numComponents, componentSize, linear, hdr, error);
+}
+
+
+ASTCRawImage* __nullable ASTCRawImage::create(char* __nonnull data, long width, long height, long bytesPerRow, long numComponents, long componentSize, bool linear, bool hdr, ASTCErrorInfo& error) {
+    return create(data, width, height, 1, bytesPerRow, numComponents, componentSize, linear, hdr, error);
+}
+
+
+ASTCRawImage* __nullable ASTCRawImage::create(char* __nonnull data, long width, long height, long depth, long bytesPerRow, long numComponents, long componentSize, bool linear, bool hdr, ASTCErrorInfo& error) {
+    // Validate input data
+    if (!validateImageParameters(data, width, height, numComponents, componentSize, hdr, error)) {
+        return nullptr;
+    }
+    
+    if (depth < 1) {
+        error.setErrorMessage("Invalid depth");
+        return nullptr;
+    }
+    
+    auto pixelSize = numComponents * componentSize;
+    if (bytesPerRow == 0) {
+        bytesPerRow = width * pixelSize;
+    }
+    else if (bytesPerRow < width * pixelSize) {
+        error.setErrorMessage("Invalid bytes per row");
         return nullptr;
     }
     
     
     // Create image data
-    auto imageDataSize = width * height * componentSize * 4;
+    auto targetPixelSize = 4 * componentSize;
+    auto targetBytesPerRow = width * targetPixelSize;
+    auto imageDataSize = depth * height * targetBytesPerRow;
     auto dataCopy = new char[imageDataSize];
     
     // Copy the whole image contents if the original number of component matches
-    if (numComponents == 4) {
+    if (numComponents == 4 && bytesPerRow == targetBytesPerRow) {
         memcpy(dataCopy, data, imageDataSize);
     }
     else {
-        memset(dataCopy, 255, imageDataSize);
-        auto pixelSize = numComponents * componentSize;
-        auto targetPixelSize = 4 * componentSize;
-        for (auto j = 0; j < height; j++) {
-            for (auto i = 0; i < width; i++) {
-                memcpy(dataCopy + (i * targetPixelSize + j * width * targetPixelSize),
-                       data + (i * pixelSize + 0 + j * width * pixelSize),
-                       pixelSize);
-            }
+        // Expand rows of all slices to 4 components, missing components are filled in the same pass
+        for (long j = 0; j < depth * height; j++) {
+            expandComponents(data + j * bytesPerRow, dataCopy + j * targetBytesPerRow, width, numComponents, componentSize);
         }
     }
     
     // TODO: Add swizzle support
     
     // Success
-    return new ASTCRawImage(dataCopy, width, height, numComponents, componentSize,
+    return new ASTCRawImage(dataCopy, width, height, depth, numComponents, componentSize,
                             linear, hdr);
 }
 
 
-ASTCImage* __nullable ASTCRawImage::compress(long blockWidth, long blockHeight, float quality, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
-    // Prepare ASTC encoder config
-    astcenc_config config;
-    auto profile = astcenc_profile::ASTCENC_PRF_LDR;
-    //auto blockWidth = 4;
-    //auto blockHeight = 4;
-    long blockDepth = 1;
+ASTCRawImage* __nullable ASTCRawImage::createNormalMap(char* __nonnull data, long width, long height, long bytesPerRow, long numComponents, long componentSize, ASTCErrorInfo& error) {
+    if (numComponents < 2) {
+        error.setErrorMessage("Normal maps need X and Y components");
+        return nullptr;
+    }
+    
+    // Normals are never sRGB encoded
+    auto image = create(data, width, height, 1, bytesPerRow, numComponents, componentSize, true, false, error);
+    if (image) {
+        image->_normalMap = true;
+    }
+    return image;
+}
+
+
+/// Progress callback of all configs. Forwards progress to the operation of the reporting thread.
+static void forwardProgress(float progress) {
+    if (currentOperation) {
+        currentOperation->reportProgress(progress);
+    }
+}
+
+
+astcenc_profile getProfile(bool linear, bool hdr, long numComponents) {
+    if (hdr) {
+        // Greyscale images with alpha are encoded with alpha in the alpha channel too
+        auto hasAlpha = numComponents == 2 || numComponents == 4;
+        return hasAlpha ? astcenc_profile::ASTCENC_PRF_HDR_RGB_LDR_A : astcenc_profile::ASTCENC_PRF_HDR;
+    }
+    
+    return linear ? astcenc_profile::ASTCENC_PRF_LDR : astcenc_profile::ASTCENC_PRF_LDR_SRGB;
+}
+
+
+ASTCCompressionOptions ASTCCompressionOptions::preset(ASTCSpeedPreset speed, ASTCContentClass contentClass) {
+    ASTCCompressionOptions options;
+    switch (speed) {
+        case ASTCSpeedPreset::fastest:
+            options.quality = ASTCENC_PRE_FASTEST;
+            break;
+            
+        case ASTCSpeedPreset::fast:
+            options.quality = ASTCENC_PRE_FAST;
+            break;
+            
+        case ASTCSpeedPreset::medium:
+            options.quality = ASTCENC_PRE_MEDIUM;
+            break;
+            
+        case ASTCSpeedPreset::thorough:
+            options.quality = ASTCENC_PRE_THOROUGH;
+            break;
+            
+        case ASTCSpeedPreset::exhaustive:
+            options.quality = ASTCENC_PRE_EXHAUSTIVE;
+            break;
+    }
+    
+    // Limits only narrow the search of the faster presets, thorough searches are left to astcenc
+    auto reducedSearch = speed == ASTCSpeedPreset::fastest || speed == ASTCSpeedPreset::fast || speed == ASTCSpeedPreset::medium;
+    switch (contentClass) {
+        case ASTCContentClass::color:
+            break;
+            
+        case ASTCContentClass::normalMap:
+            // Normals vary smoothly, blocks with more than 2 partitions rarely win. The angular error metric is worth its cost on thorough presets only
+            if (reducedSearch) {
+                options.partitionCountLimit = 2;
+            }
+            else {
+                options.perceptual = true;
+            }
+            break;
+            
+        case ASTCContentClass::mask:
+            // Masks are mostly flat, the search can stop as soon as a block is good enough
+            if (reducedSearch) {
+                options.partitionCountLimit = 2;
+                options.twoPartitionEarlyOutLimitFactor = 1.0f;
+            }
+            break;
+            
+        case ASTCContentClass::ui:
+            // Sharp edges need partitions even on the fastest presets, transparent texels don't need precision. Atlases repeat glyphs and padding
+            options.alphaWeighted = true;
+            options.deduplicateBlocks = true;
+            if (speed == ASTCSpeedPreset::fastest || speed == ASTCSpeedPreset::fast) {
+                options.partitionCountLimit = 3;
+            }
+            break;
+    }
+    
+    return options;
+}
+
+
+/// Overrides an astcenc tuning value if the option is set.
+template <typename Value, typename Option>
+static void overrideTuning(Value& value, Option option) {
+    if (option > 0) {
+        value = static_cast<Value>(option);
+    }
+}
+
+
+astcenc_error initCompressionConfig(astcenc_profile profile, long numComponents, unsigned int flags, long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, astcenc_config* __nonnull config) {
+    if (options.alphaWeighted) {
+        flags |= ASTCENC_FLG_USE_ALPHA_WEIGHT;
+    }
+    if (options.perceptual) {
+        flags |= ASTCENC_FLG_USE_PERCEPTUAL;
+    }
+    
     auto result = astcenc_config_init(profile,
                                       static_cast<unsigned int>(blockWidth),
                                       static_cast<unsigned int>(blockHeight),
                                       static_cast<unsigned int>(blockDepth),
-                                      quality,
-                                      0/*ASTCENC_FLG_USE_DECODE_UNORM8*/,
-                                      &config);
+                                      options.quality,
+                                      flags/* | ASTCENC_FLG_USE_DECODE_UNORM8*/,
+                                      config);
     if (result != astcenc_error::ASTCENC_SUCCESS) {
-        error.setErrorMessage("Could not initialise config");
-        return nullptr;
+        return result;
     }
+    
+    // Search limits that aren't set keep the values astcenc derived from the quality
+    overrideTuning(config->tune_partition_count_limit, options.partitionCountLimit);
+    overrideTuning(config->tune_2partition_index_limit, options.twoPartitionIndexLimit);
+    overrideTuning(config->tune_3partition_index_limit, options.threePartitionIndexLimit);
+    overrideTuning(config->tune_4partition_index_limit, options.fourPartitionIndexLimit);
+    overrideTuning(config->tune_block_mode_limit, options.blockModeLimit);
+    overrideTuning(config->tune_refinement_limit, options.refinementLimit);
+    overrideTuning(config->tune_candidate_limit, options.candidateLimit);
+    overrideTuning(config->tune_2partitioning_candidate_limit, options.twoPartitioningCandidateLimit);
+    overrideTuning(config->tune_3partitioning_candidate_limit, options.threePartitioningCandidateLimit);
+    overrideTuning(config->tune_4partitioning_candidate_limit, options.fourPartitioningCandidateLimit);
+    overrideTuning(config->tune_db_limit, options.dbLimit);
+    overrideTuning(config->tune_mse_overshoot, options.mseOvershoot);
+    overrideTuning(config->tune_2partition_early_out_limit_factor, options.twoPartitionEarlyOutLimitFactor);
+    overrideTuning(config->tune_3partition_early_out_limit_factor, options.threePartitionEarlyOutLimitFactor);
+    overrideTuning(config->tune_2plane_early_out_limit_correlation, options.twoPlaneEarlyOutLimitCorrelation);
+    overrideTuning(config->a_scale_radius, options.alphaScaleRadius);
+    
+    // Scale the weights astcenc chose for the profile and flags, normal maps come with their own
+    config->cw_r_weight *= options.redWeight;
+    config->cw_g_weight *= options.greenWeight;
+    config->cw_b_weight *= options.blueWeight;
+    config->cw_a_weight *= options.alphaWeight;
+    
+    // Only weigh errors of components with actual content. Luminance is replicated to RGB by the swizzle, so its error is counted once
+    switch (numComponents) {
+        case 1:
+            config->cw_g_weight = 0;
+            config->cw_b_weight = 0;
+            config->cw_a_weight = 0;
+            break;
+            
+        case 2:
+            config->cw_g_weight = 0;
+            config->cw_b_weight = 0;
+            break;
+            
+        case 3:
+            config->cw_a_weight = 0;
+            break;
+            
+        default:
+            break;
+    }
+    
     // Power user settings
-    config.progress_callback = [](float progress) {
-        if (callbackContext.callback == nullptr) {
-            return;
-        }
-        
-        // Don't process if cancelled
-        if (callbackContext.cancelled) {
-            return;
-        }
-        
-        // Execute callback
-        // TODO: We can also send back image data to see the live preview!
-        auto shouldStop = callbackContext.callback(callbackContext.userInfo, progress);
-        if (shouldStop) {
-            callbackContext.cancelled = true;
-            astcenc_compress_cancel(callbackContext.context);
-        }
-    };
+    config->progress_callback = forwardProgress;
     
-    astcenc_context* context = nullptr;
-    auto numThreads = 1; //std::thread::hardware_concurrency();
-    result = astcenc_context_alloc(&config, numThreads, &context);
+    return astcenc_error::ASTCENC_SUCCESS;
+}
+
+
+astcenc_error initDecompressionConfig(astcenc_profile profile, long blockWidth, long blockHeight, long blockDepth, astcenc_config* __nonnull config) {
+    auto result = astcenc_config_init(profile,
+                                      static_cast<unsigned int>(blockWidth),
+                                      static_cast<unsigned int>(blockHeight),
+                                      static_cast<unsigned int>(blockDepth),
+                                      ASTCENC_PRE_MEDIUM, // ASTCENC_PRE_EXHAUSTIVE,
+                                      /*ASTCENC_FLG_USE_DECODE_UNORM8 |*/ ASTCENC_FLG_DECOMPRESS_ONLY,
+                                      config);
     if (result != astcenc_error::ASTCENC_SUCCESS) {
-        error.setErrorMessage("Could not create context");
+        return result;
+    }
+    
+    // Power user settings
+    config->progress_callback = forwardProgress;
+    
+    return astcenc_error::ASTCENC_SUCCESS;
+}
+
+
+ASTCRawImage* __nullable ASTCRawImage::createWithoutCopy(char* __nonnull data, long width, long height, long numComponents, long componentSize, bool linear, bool hdr, void* __nullable releaseUserInfo, ASTCReleaseCallback __nullable releaseCallback, ASTCErrorInfo& error) {
+    // Validate input data
+    if (!validateImageParameters(data, width, height, numComponents, componentSize, hdr, error)) {
         return nullptr;
     }
     
+    // The data is already in the layout the encoder expects, so just take it over
+    return new ASTCRawImage(data, width, height, 1, numComponents, componentSize,
+                            linear, hdr, releaseUserInfo, releaseCallback);
+}
+
+
+long ASTCRawImage::getCompressedDataSize(long blockWidth, long blockHeight, long blockDepth) {
+    if (blockWidth <= 0 || blockHeight <= 0 || blockDepth <= 0) {
+        return 0;
+    }
     
-    // Set callback context
-    callbackContext.context = context;
-    callbackContext.userInfo = userInfo;
-    callbackContext.callback = progressCallback;
-    callbackContext.cancelled = false;
+    auto astcXCount = (_width + blockWidth - 1) / blockWidth;
+    auto astcYCount = (_height + blockHeight - 1) / blockHeight;
+    auto astcZCount = (_depth + blockDepth - 1) / blockDepth;
+    return astcXCount * astcYCount * astcZCount * 16;
+}
+
+
+ASTCImage* __nullable ASTCRawImage::compress(long blockWidth, long blockHeight, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    return compress(blockWidth, blockHeight, 1, quality, numThreads, error, userInfo, progressCallback);
+}
+
+
+ASTCImage* __nullable ASTCRawImage::compress(long blockWidth, long blockHeight, long blockDepth, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    return compress(blockWidth, blockHeight, blockDepth, ASTCCompressionOptions { .quality = quality }, numThreads, error, userInfo, progressCallback);
+}
+
+
+ASTCImage* __nullable ASTCRawImage::compress(long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    auto dataLength = getCompressedDataSize(blockWidth, blockHeight, blockDepth);
+    if (dataLength == 0) {
+        error.setErrorMessage("Unsupported block size");
+        return nullptr;
+    }
     
+    // The encoder writes every block, so the output doesn't need to be cleared
+    char* astcData = new char[dataLength];
+    ASTCBlockStatistics statistics;
+    if (!compressInto(astcData, dataLength, blockWidth, blockHeight, blockDepth, options, numThreads, statistics, error, userInfo, progressCallback)) {
+        delete [] astcData;
+        return nullptr;
+    }
     
-    // Prepare image data
-    astcenc_image image;
-    switch (_componentSize) {
-        case 1: image.data_type = astcenc_type::ASTCENC_TYPE_U8; break;
-        case 2: image.data_type = astcenc_type::ASTCENC_TYPE_F16; break;
-        case 4: image.data_type = astcenc_type::ASTCENC_TYPE_F32; break;
-        default:
-            error.setErrorMessage("Unsupported component size");
-            astcenc_context_free(context);
-            callbackContext.reset();
-            return nullptr;
+    auto image = createCompressedImage(astcData, blockWidth, blockHeight, blockDepth);
+    image->_blockStatistics = statistics;
+    return image;
+}
+
+
+bool ASTCRawImage::compressInto(char* __nonnull buffer, long capacity, long blockWidth, long blockHeight, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    return compressInto(buffer, capacity, blockWidth, blockHeight, 1, quality, numThreads, error, userInfo, progressCallback);
+}
+
+
+bool ASTCRawImage::compressInto(char* __nonnull buffer, long capacity, long blockWidth, long blockHeight, long blockDepth, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    return compressInto(buffer, capacity, blockWidth, blockHeight, blockDepth, ASTCCompressionOptions { .quality = quality }, numThreads, error, userInfo, progressCallback);
+}
+
+
+bool ASTCRawImage::compressInto(char* __nonnull buffer, long capacity, long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    ASTCBlockStatistics statistics;
+    return compressInto(buffer, capacity, blockWidth, blockHeight, blockDepth, options, numThreads, statistics, error, userInfo, progressCallback);
+}
+
+
+bool ASTCRawImage::compressInto(char* __nonnull buffer, long capacity, long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, long numThreads, ASTCBlockStatistics& statistics, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    // Prepare ASTC encoder config
+    astcenc_config config;
+    if (!makeCompressionConfig(blockWidth, blockHeight, blockDepth, options, &config)) {
+        error.setErrorMessage("Could not initialise config");
+        return false;
     }
-    image.dim_x = static_cast<unsigned int>(_width);
-    image.dim_y = static_cast<unsigned int>(_height);
-    image.dim_z = static_cast<unsigned int>(1);
-    // Data is always passed as 4 component image array
-    char* content = _data;
-    image.data = reinterpret_cast<void**>(&content);
     
-    // Prepare swizzle info
+    auto dataLength = getCompressedDataSize(blockWidth, blockHeight, blockDepth);
+    if (capacity < dataLength) {
+        error.setErrorMessage("Buffer is too small");
+        return false;
+    }
+    
+    // Blocks of all slices are shared by the threads of the context
+    astcenc_context* context = nullptr;
+    auto contextNumThreads = resolveNumThreads(numThreads, dataLength / 16);
+    auto result = acquireContext(config, contextNumThreads, &context);
+    if (result != astcenc_error::ASTCENC_SUCCESS) {
+        error.setErrorMessage("Could not create context");
+        return false;
+    }
+    
+    auto success = compressWithContext(context, config, options, contextNumThreads, blockWidth, blockHeight, blockDepth, buffer, dataLength, statistics, error, userInfo, progressCallback);
+    
+    // Clean up
+    releaseContext(context);
+    
+    return success;
+}
+
+
+bool ASTCRawImage::makeCompressionConfig(long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, astcenc_config* __nonnull config) {
+    // Normal maps are encoded like greyscale images with alpha, astcenc tunes its search and error metric for normals with the flag
+    if (_normalMap) {
+        return initCompressionConfig(astcenc_profile::ASTCENC_PRF_LDR, 2, ASTCENC_FLG_MAP_NORMAL, blockWidth, blockHeight, blockDepth, options, config) == astcenc_error::ASTCENC_SUCCESS;
+    }
+    
+    auto profile = getProfile(_linear, _hdr, _originalNumComponents);
+    return initCompressionConfig(profile, _originalNumComponents, 0, blockWidth, blockHeight, blockDepth, options, config) == astcenc_error::ASTCENC_SUCCESS;
+}
+
+
+/// Maps the components of an image to what the encoder sees.
+///
+/// Greyscale images are encoded as RRR1 and greyscale images with alpha as RRRG, so blocks are recognised as luminance and take astcenc's cheaper luminance paths. Components the image doesn't have are encoded as constant `1`.
+static astcenc_swizzle getCompressionSwizzle(long numComponents) {
     astcenc_swizzle swizzle;
-#if 0
-    swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
-    //swizzle.a = astcenc_swz::ASTCENC_SWZ_1;
     switch (numComponents) {
-        case 4: swizzle.a = astcenc_swz::ASTCENC_SWZ_A;
-        case 3: swizzle.b = astcenc_swz::ASTCENC_SWZ_B;
-        case 2: swizzle.g = astcenc_swz::ASTCENC_SWZ_G;
-        case 1: break;
+        case 1:
+            swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
+            swizzle.g = astcenc_swz::ASTCENC_SWZ_R;
+            swizzle.b = astcenc_swz::ASTCENC_SWZ_R;
+            swizzle.a = astcenc_swz::ASTCENC_SWZ_1;
+            break;
+            
+        case 2:
+            swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
+            swizzle.g = astcenc_swz::ASTCENC_SWZ_R;
+            swizzle.b = astcenc_swz::ASTCENC_SWZ_R;
+            swizzle.a = astcenc_swz::ASTCENC_SWZ_G;
+            break;
+            
+        case 3:
+            swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
+            swizzle.g = astcenc_swz::ASTCENC_SWZ_G;
+            swizzle.b = astcenc_swz::ASTCENC_SWZ_B;
+            swizzle.a = astcenc_swz::ASTCENC_SWZ_1;
+            break;
             
         default:
-            error.setErrorMessage("Unsupported number of components");
-            astcenc_context_free(context);
-            callbackContext.reset();
-            return nullptr;
-    }
-#else
-    swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
-    swizzle.g = astcenc_swz::ASTCENC_SWZ_G;
-    swizzle.b = astcenc_swz::ASTCENC_SWZ_B;
-//    swizzle.a = astcenc_swz::ASTCENC_SWZ_A;
-    swizzle.a = astcenc_swz::ASTCENC_SWZ_1;
-#endif
-    
-    // Allocate memory for astc compressed output image
-    auto astcXCount = static_cast<long>(ceilf(static_cast<float>(_width) / static_cast<float>(blockWidth)));
-    auto astcYCount = static_cast<long>(ceilf(static_cast<float>(_height) / static_cast<float>(blockHeight)));
-    size_t dataLength = astcXCount * astcYCount * blockDepth * 16;
+            swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
+            swizzle.g = astcenc_swz::ASTCENC_SWZ_G;
+            swizzle.b = astcenc_swz::ASTCENC_SWZ_B;
+            swizzle.a = astcenc_swz::ASTCENC_SWZ_A;
+            break;
+    }
+    return swizzle;
+}
+
+
+ASTCImage* __nullable ASTCRawImage::compressWithContext(astcenc_context* __nonnull context, const astcenc_config& config, const ASTCCompressionOptions& options, unsigned int numThreads, long blockWidth, long blockHeight, long blockDepth, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    auto dataLength = getCompressedDataSize(blockWidth, blockHeight, blockDepth);
     char* astcData = new char[dataLength];
-    memset(astcData, 0, dataLength);
+    ASTCBlockStatistics statistics;
+    if (!compressWithContext(context, config, options, numThreads, blockWidth, blockHeight, blockDepth, astcData, dataLength, statistics, error, userInfo, progressCallback)) {
+        delete [] astcData;
+        return nullptr;
+    }
     
-    // Compress image
-    auto compressedData = reinterpret_cast<uint8_t*>(astcData);
-    result = astcenc_compress_image(context, &image, &swizzle, compressedData, dataLength, 0);
+    auto image = createCompressedImage(astcData, blockWidth, blockHeight, blockDepth);
+    image->_blockStatistics = statistics;
+    return image;
+}
+
+
+/// Compresses `image` on `numThreads` threads that share `context`.
+static bool compressImage(astcenc_context* __nonnull context, unsigned int numThreads, astcenc_image& image, const astcenc_swizzle& swizzle, uint8_t* __nonnull compressedData, size_t dataLength, ASTCOperation& operation, ASTCErrorInfo& error) {
+    // Every thread works on the same context and picks up blocks until the whole image is done
+    std::atomic<astcenc_error> compressionResult = astcenc_error::ASTCENC_SUCCESS;
+    runOnThreads(numThreads, [&](unsigned int threadIndex) {
+        // astcenc reports progress from whichever thread is running, so every worker publishes the operation
+        ASTCOperationScope operationScope(&operation);
+        
+        auto threadResult = astcenc_compress_image(context, &image, &swizzle, compressedData, dataLength, threadIndex);
+        if (threadResult != astcenc_error::ASTCENC_SUCCESS) {
+            compressionResult = threadResult;
+        }
+    });
+    auto result = compressionResult.load();
     if (result != astcenc_error::ASTCENC_SUCCESS) {
         error.setErrorMessage("Could not compress image");
-        delete [] astcData;
-        astcenc_context_free(context);
-        callbackContext.reset();
-        return nullptr;
+        return false;
     }
     
     // Check if task was cancelled
-    if (callbackContext.cancelled) {
+    if (operation.cancelled) {
         error.setErrorMessage("Task was cancelled");
-        delete [] astcData;
-        astcenc_context_free(context);
-        callbackContext.reset();
-        return nullptr;
+        return false;
+    }
+    
+    return true;
+}
+
+
+/// Describes `depth` slices of 4 component pixels at `data` to the encoder. `slices` keeps the slice pointers `image` refers to.
+static bool initEncoderImage(char* __nonnull data, long width, long height, long depth, long componentSize, std::vector<void*>& slices, astcenc_image& image, ASTCErrorInfo& error) {
+    switch (componentSize) {
+        case 1: image.data_type = astcenc_type::ASTCENC_TYPE_U8; break;
+        case 2: image.data_type = astcenc_type::ASTCENC_TYPE_F16; break;
+        case 4: image.data_type = astcenc_type::ASTCENC_TYPE_F32; break;
+        default:
+            error.setErrorMessage("Unsupported component size");
+            return false;
+    }
+    image.dim_x = static_cast<unsigned int>(width);
+    image.dim_y = static_cast<unsigned int>(height);
+    image.dim_z = static_cast<unsigned int>(depth);
+    // Data is always passed as 4 component image array, one pointer per slice
+    slices = getImageSlices(data, width * height * 4 * componentSize, depth);
+    image.data = slices.data();
+    return true;
+}
+
+
+/// Compresses the 2D blocks of `image` listed in `blockIndices` into `compressedData`, which holds the blocks of the whole image. Other blocks are left as they are.
+///
+/// With `constantBlocks` blocks of a single colour are written directly as LDR constant colour blocks, and with `deduplicateBlocks` repeated blocks are encoded once. The encoder only sees the rest, packed next to each other, unless too few blocks were skipped to pay for the copy.
+static bool compressBlocks(astcenc_context* __nonnull context, unsigned int numThreads, astcenc_image& image, const astcenc_swizzle& swizzle, long blockWidth, long blockHeight, bool constantBlocks, bool deduplicateBlocks, std::vector<uint32_t>& blockIndices, uint8_t* __nonnull compressedData, ASTCBlockStatistics& statistics, ASTCOperation& operation, ASTCErrorInfo& error) {
+    auto numBlocks = static_cast<long>(blockIndices.size());
+    if (constantBlocks) {
+        encodeConstantBlocks(image, swizzle, blockWidth, blockHeight, numThreads, compressedData, blockIndices);
+        statistics.numConstantBlocks = numBlocks - static_cast<long>(blockIndices.size());
+    }
+    
+    std::vector<ASTCDuplicateBlock> duplicateBlocks;
+    if (deduplicateBlocks) {
+        removeDuplicateBlocks(image, blockWidth, blockHeight, numThreads, blockIndices, duplicateBlocks);
+        statistics.numDuplicateBlocks = static_cast<long>(duplicateBlocks.size());
+    }
+    
+    // Packing the remaining blocks copies their texels, which only pays off if enough blocks are skipped. Otherwise the encoder takes the whole image as it is
+    auto numRemainingBlocks = static_cast<long>(blockIndices.size());
+    auto numBlocksWidth = (static_cast<long>(image.dim_x) + blockWidth - 1) / blockWidth;
+    auto numBlocksHeight = (static_cast<long>(image.dim_y) + blockHeight - 1) / blockHeight;
+    auto numImageBlocks = numBlocksWidth * numBlocksHeight * static_cast<long>(image.dim_z);
+    if (numBlocks == numImageBlocks && (numBlocks - numRemainingBlocks) * ASTC_MIN_SKIPPED_BLOCKS_DIVISOR < numBlocks) {
+        // The encoder overwrites the constant blocks, so they're kept aside and put back. Duplicates come out the same as their originals anyway
+        std::vector<uint8_t> encodedBlocks(static_cast<size_t>(numImageBlocks));
+        for (auto blockIndex: blockIndices) {
+            encodedBlocks[blockIndex] = 1;
+        }
+        for (auto& duplicateBlock: duplicateBlocks) {
+            encodedBlocks[duplicateBlock.blockIndex] = 1;
+        }
+        
+        std::vector<uint8_t> constantBlockData(static_cast<size_t>(statistics.numConstantBlocks * 16));
+        for (long blockIndex = 0, i = 0; blockIndex < numImageBlocks; blockIndex++) {
+            if (encodedBlocks[blockIndex] == 0) {
+                memcpy(constantBlockData.data() + i++ * 16, compressedData + blockIndex * 16, 16);
+            }
+        }
+        
+        if (!compressImage(context, numThreads, image, swizzle, compressedData, static_cast<size_t>(numImageBlocks * 16), operation, error)) {
+            return false;
+        }
+        
+        for (long blockIndex = 0, i = 0; blockIndex < numImageBlocks; blockIndex++) {
+            if (encodedBlocks[blockIndex] == 0) {
+                memcpy(compressedData + blockIndex * 16, constantBlockData.data() + i++ * 16, 16);
+            }
+        }
+        return true;
+    }
+    
+    if (numRemainingBlocks > 0) {
+        // The encoder only sees the remaining blocks, packed next to each other in rows as wide as the image
+        auto packedBlocksWidth = std::min(numBlocksWidth, numRemainingBlocks);
+        auto packedBlocksHeight = (numRemainingBlocks + packedBlocksWidth - 1) / packedBlocksWidth;
+        auto pixelSize = 4 * getComponentSize(image.data_type);
+        std::vector<char> packedData(packedBlocksWidth * blockWidth * packedBlocksHeight * blockHeight * pixelSize);
+        packBlocks(image, blockWidth, blockHeight, blockIndices, packedBlocksWidth, packedData.data());
+        
+        astcenc_image packedImage = image;
+        packedImage.dim_x = static_cast<unsigned int>(packedBlocksWidth * blockWidth);
+        packedImage.dim_y = static_cast<unsigned int>(packedBlocksHeight * blockHeight);
+        packedImage.dim_z = 1;
+        void* packedSlices[] = { packedData.data() };
+        packedImage.data = packedSlices;
+        
+        std::vector<uint8_t> packedBlocks(packedBlocksWidth * packedBlocksHeight * 16);
+        if (!compressImage(context, numThreads, packedImage, swizzle, packedBlocks.data(), packedBlocks.size(), operation, error)) {
+            return false;
+        }
+        
+        // Move the blocks to their place in the image, unused slots of the last row are dropped
+        for (long i = 0; i < numRemainingBlocks; i++) {
+            memcpy(compressedData + static_cast<long>(blockIndices[i]) * 16, packedBlocks.data() + i * 16, 16);
+        }
+    }
+    else {
+        // The encoder didn't run, so nothing reported progress yet
+        operation.reportProgress(100);
+        if (operation.cancelled) {
+            error.setErrorMessage("Task was cancelled");
+            return false;
+        }
+    }
+    
+    // Originals are in place now
+    for (auto& duplicateBlock: duplicateBlocks) {
+        memcpy(compressedData + static_cast<long>(duplicateBlock.blockIndex) * 16, compressedData + static_cast<long>(duplicateBlock.originalBlockIndex) * 16, 16);
+    }
+    return true;
+}
+
+
+bool ASTCRawImage::compressWithContext(astcenc_context* __nonnull context, const astcenc_config& config, const ASTCCompressionOptions& options, unsigned int numThreads, long blockWidth, long blockHeight, long blockDepth, char* __nonnull buffer, long dataLength, ASTCBlockStatistics& statistics, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    // State shared by all worker threads
+    ASTCOperation operation(context, userInfo, progressCallback);
+    
+    
+    // Prepare image data
+    astcenc_image image;
+    std::vector<void*> slices;
+    if (!initEncoderImage(_data, _width, _height, _depth, _componentSize, slices, image, error)) {
+        return false;
+    }
+    
+    // Prepare swizzle info
+    auto swizzle = getCompressionSwizzle(_normalMap ? 2 : _originalNumComponents);
+    auto compressedData = reinterpret_cast<uint8_t*>(buffer);
+    
+    // Blocks of a single colour are written directly and repeated blocks are encoded once. HDR images store constant blocks in another format, and alpha scaling makes blocks depend on their neighbours
+    auto ldr = config.profile == astcenc_profile::ASTCENC_PRF_LDR || config.profile == astcenc_profile::ASTCENC_PRF_LDR_SRGB;
+    auto alphaScaling = (config.flags & ASTCENC_FLG_USE_ALPHA_WEIGHT) != 0 && config.a_scale_radius > 0;
+    auto constantBlocks = ldr && options.detectConstantBlocks;
+    if (blockDepth == 1 && !alphaScaling && (constantBlocks || options.deduplicateBlocks)) {
+        std::vector<uint32_t> blockIndices(static_cast<size_t>(dataLength / 16));
+        std::iota(blockIndices.begin(), blockIndices.end(), 0);
+        return compressBlocks(context, numThreads, image, swizzle, blockWidth, blockHeight, constantBlocks, options.deduplicateBlocks, blockIndices, compressedData, statistics, operation, error);
+    }
+    
+    return compressImage(context, numThreads, image, swizzle, compressedData, static_cast<size_t>(dataLength), operation, error);
+}
+
+
+bool ASTCRawImage::compressBlocksInto(char* __nonnull buffer, long blockWidth, long blockHeight, const ASTCCompressionOptions& options, long numThreads, std::vector<uint32_t>& blockIndices, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    // Prepare ASTC encoder config
+    astcenc_config config;
+    if (!makeCompressionConfig(blockWidth, blockHeight, 1, options, &config)) {
+        error.setErrorMessage("Could not initialise config");
+        return false;
     }
     
+    astcenc_image image;
+    std::vector<void*> slices;
+    if (!initEncoderImage(_data, _width, _height, _depth, _componentSize, slices, image, error)) {
+        return false;
+    }
+    
+    astcenc_context* context = nullptr;
+    auto contextNumThreads = resolveNumThreads(numThreads, static_cast<long>(blockIndices.size()));
+    auto result = acquireContext(config, contextNumThreads, &context);
+    if (result != astcenc_error::ASTCENC_SUCCESS) {
+        error.setErrorMessage("Could not create context");
+        return false;
+    }
+    
+    // Same shortcuts as for the whole image
+    auto swizzle = getCompressionSwizzle(_normalMap ? 2 : _originalNumComponents);
+    auto ldr = config.profile == astcenc_profile::ASTCENC_PRF_LDR || config.profile == astcenc_profile::ASTCENC_PRF_LDR_SRGB;
+    auto alphaScaling = (config.flags & ASTCENC_FLG_USE_ALPHA_WEIGHT) != 0 && config.a_scale_radius > 0;
+    ASTCOperation operation(context, userInfo, progressCallback);
+    ASTCBlockStatistics statistics;
+    auto success = compressBlocks(context, contextNumThreads, image, swizzle, blockWidth, blockHeight, ldr && options.detectConstantBlocks && !alphaScaling, options.deduplicateBlocks && !alphaScaling, blockIndices, reinterpret_cast<uint8_t*>(buffer), statistics, operation, error);
+    
     // Clean up
-    astcenc_context_free(context);
-    callbackContext.reset();
+    releaseContext(context);
+    
+    return success;
+}
+
+
+ASTCImage* __nonnull ASTCRawImage::createCompressedImage(char* __nonnull astcData, long blockWidth, long blockHeight, long blockDepth) {
+    auto astcXCount = (_width + blockWidth - 1) / blockWidth;
+    auto astcYCount = (_height + blockHeight - 1) / blockHeight;
+    auto astcZCount = (_depth + blockDepth - 1) / blockDepth;
+    auto image = new ASTCImage(astcData, _width, _height, _depth, _originalNumComponents, _componentSize, _linear, _hdr, astcXCount, astcYCount, astcZCount, blockWidth, blockHeight, blockDepth);
+    image->_normalMap = _normalMap;
+    return image;
+}
+
+
+
+ASTCRawImage* __nonnull ASTCRawImage::createRowView(long z, long y, long numRows) {
+    auto rows = _data + ((z * _height) + y) * _width * 4 * _componentSize;
+    ASTCReleaseCallback keepRows = [](void* __nullable, void* __nonnull) {
+        // Done
+    };
     
-    return new ASTCImage(astcData, _width, _height, 1, _originalNumComponents, _componentSize, _linear, _hdr, astcXCount, astcYCount, 1, blockWidth, blockHeight, blockDepth);
+    auto image = new ASTCRawImage(rows, _width, numRows, 1, _originalNumComponents, _componentSize, _linear, _hdr, nullptr, keepRows);
+    image->_normalMap = _normalMap;
+    return image;
 }
 
 
 // MARK: - ASTCImage
 
-ASTCImage::ASTCImage(char* __nonnull data, long width, long height, long depth, long originalNumComponents, long componentSize, bool linear, bool hdr, long numBlocksWidth, long numBlocksHeight, long numBlocksDepth, long blockWidth, long blockHeight, long blockDepth):
+ASTCImage::ASTCImage(char* __nonnull data, long width, long height, long depth, long originalNumComponents, long componentSize, bool linear, bool hdr, long numBlocksWidth, long numBlocksHeight, long numBlocksDepth, long blockWidth, long blockHeight, long blockDepth, void* __nullable releaseUserInfo, ASTCReleaseCallback __nullable releaseCallback):
 referenceCounter(1),
 _data(data),
 _width(width),
@@ -333,17 +852,26 @@ _originalNumComponents(originalNumComponents),
 _componentSize(componentSize),
 _linear(linear),
 _hdr(hdr),
+_normalMap(false),
+_blockStatistics(),
 _numBlocksWidth(numBlocksWidth),
 _numBlocksHeight(numBlocksHeight),
 _numBlocksDepth(numBlocksDepth),
 _blockWidth(blockWidth),
 _blockHeight(blockHeight),
-_blockDepth(blockDepth) {
+_blockDepth(blockDepth),
+_releaseUserInfo(releaseUserInfo),
+_releaseCallback(releaseCallback) {
     // Done
 }
 
 ASTCImage::~ASTCImage() {
-    delete [] _data;
+    if (_releaseCallback) {
+        _releaseCallback(_releaseUserInfo, _data);
+    }
+    else {
+        delete [] _data;
+    }
 }
 
 
@@ -362,110 +890,317 @@ void ASTCImageRelease(ASTCImage* __nullable image) {
 }
 
 
-ASTCRawImage* __nullable ASTCImage::decompress(ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
-    // Prepare ASTC encoder config
-    astcenc_config config;
-    auto profile = astcenc_profile::ASTCENC_PRF_LDR;
-    auto result = astcenc_config_init(profile,
-                                      static_cast<unsigned int>(_blockWidth),
-                                      static_cast<unsigned int>(_blockHeight),
-                                      static_cast<unsigned int>(_blockDepth),
-                                      ASTCENC_PRE_MEDIUM, // ASTCENC_PRE_EXHAUSTIVE,
-                                      /*ASTCENC_FLG_USE_DECODE_UNORM8 |*/ ASTCENC_FLG_DECOMPRESS_ONLY,
-                                      &config);
-    if (result != astcenc_error::ASTCENC_SUCCESS) {
-        error.setErrorMessage("Could not initialise config");
-        return nullptr;
+/// Swizzle that restores the layout of ``ASTCRawImage`` data from decoded blocks.
+/// Restores the component layout of the original image from blocks encoded with ``getCompressionSwizzle``. Components the image didn't have are set to `1`, just like ``expandComponents`` does.
+///
+/// Normal maps store X in RGB and Y in alpha, astcenc computes Z from them while decoding.
+static astcenc_swizzle getDecompressionSwizzle(long numComponents, bool normalMap) {
+    astcenc_swizzle swizzle;
+    if (normalMap) {
+        swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
+        swizzle.g = astcenc_swz::ASTCENC_SWZ_A;
+        swizzle.b = astcenc_swz::ASTCENC_SWZ_Z;
+        swizzle.a = astcenc_swz::ASTCENC_SWZ_1;
+        return swizzle;
     }
-    // Power user settings
-    config.progress_callback = [](float progress) {
-        if (callbackContext.callback == nullptr) {
-            return;
-        }
-        
-        // Execute callback
-        callbackContext.callback(callbackContext.userInfo, progress);
-    };
     
-    astcenc_context* context = nullptr;
-    auto numThreads = 1; //std::thread::hardware_concurrency();
-    result = astcenc_context_alloc(&config, numThreads, &context);
-    if (result != astcenc_error::ASTCENC_SUCCESS) {
-        error.setErrorMessage("Could not create context");
+    switch (numComponents) {
+        case 1:
+            swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
+            swizzle.g = astcenc_swz::ASTCENC_SWZ_1;
+            swizzle.b = astcenc_swz::ASTCENC_SWZ_1;
+            swizzle.a = astcenc_swz::ASTCENC_SWZ_1;
+            break;
+            
+        case 2:
+            swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
+            swizzle.g = astcenc_swz::ASTCENC_SWZ_A;
+            swizzle.b = astcenc_swz::ASTCENC_SWZ_1;
+            swizzle.a = astcenc_swz::ASTCENC_SWZ_1;
+            break;
+            
+        case 3:
+            swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
+            swizzle.g = astcenc_swz::ASTCENC_SWZ_G;
+            swizzle.b = astcenc_swz::ASTCENC_SWZ_B;
+            swizzle.a = astcenc_swz::ASTCENC_SWZ_1;
+            break;
+            
+        default:
+            swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
+            swizzle.g = astcenc_swz::ASTCENC_SWZ_G;
+            swizzle.b = astcenc_swz::ASTCENC_SWZ_B;
+            swizzle.a = astcenc_swz::ASTCENC_SWZ_A;
+            break;
+    }
+    return swizzle;
+}
+
+
+static bool getImageDataType(long componentSize, astcenc_type& dataType) {
+    switch (componentSize) {
+        case 1: dataType = astcenc_type::ASTCENC_TYPE_U8; return true;
+        case 2: dataType = astcenc_type::ASTCENC_TYPE_F16; return true;
+        case 4: dataType = astcenc_type::ASTCENC_TYPE_F32; return true;
+        default: return false;
+    }
+}
+
+
+ASTCRawImage* __nullable ASTCImage::decompress(long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    // Data is always decompressed as 4 component image array
+    auto content = new char[_width * _height * _depth * 4 * _componentSize];
+    if (!decompressInto(content, 0, numThreads, error, userInfo, progressCallback)) {
+        delete [] content;
         return nullptr;
     }
     
+    auto image = new ASTCRawImage(content, _width, _height, _depth, _originalNumComponents, _componentSize, _linear, _hdr);
+    image->_normalMap = _normalMap;
+    return image;
+}
+
+
+bool ASTCImage::decompressInto(char* __nonnull buffer, long bytesPerRow, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    return decompressInto(buffer, bytesPerRow, 4, _componentSize, numThreads, error, userInfo, progressCallback);
+}
+
+
+bool ASTCImage::decompressInto(char* __nonnull buffer, long bytesPerRow, long numComponents, long componentSize, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    if (numComponents < 1 || numComponents > 4) {
+        error.setErrorMessage("Unsupported number of components");
+        return false;
+    }
     
-    // Set callback context
-    callbackContext.context = context;
-    callbackContext.userInfo = userInfo;
-    callbackContext.callback = progressCallback;
-    callbackContext.cancelled = false;
+    // astcenc converts to the requested component type itself
+    astcenc_type dataType;
+    if (!getImageDataType(componentSize, dataType)) {
+        error.setErrorMessage("Unsupported component size");
+        return false;
+    }
     
+    auto pixelSize = numComponents * componentSize;
+    auto packedBytesPerRow = _width * pixelSize;
+    if (bytesPerRow == 0) {
+        bytesPerRow = packedBytesPerRow;
+    }
+    else if (bytesPerRow < packedBytesPerRow) {
+        error.setErrorMessage("Invalid bytes per row");
+        return false;
+    }
     
-    // Prepare image data
-    astcenc_image image;
-    switch (_componentSize) {
-        case 1: image.data_type = astcenc_type::ASTCENC_TYPE_U8; break;
-        case 2: image.data_type = astcenc_type::ASTCENC_TYPE_F16; break;
-        case 4: image.data_type = astcenc_type::ASTCENC_TYPE_F32; break;
-        default:
-            error.setErrorMessage("Unsupported component size");
-            astcenc_context_free(context);
-            callbackContext.reset();
-            return nullptr;
-    }
-    image.dim_x = static_cast<unsigned int>(_width);
-    image.dim_y = static_cast<unsigned int>(_height);
-    image.dim_z = static_cast<unsigned int>(_depth);
-    // Data is always passed as 4 component image array
-    auto content = new char[_width * _height * _depth * 4 * _componentSize];
-    image.data = reinterpret_cast<void**>(&content);
+    // astcenc only writes tightly packed 4 component rows, those are decoded in place. Everything else is repacked straight into `buffer` while the strip is still in cache
+    if (numComponents == 4 && bytesPerRow == packedBytesPerRow) {
+        return decodeBlockRows(0, 0, _width, _height, componentSize, buffer, numThreads, error, userInfo, progressCallback, nullptr);
+    }
     
-    // Prepare swizzle info
-    astcenc_swizzle swizzle;
-#if 0
-    swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
-    //swizzle.a = astcenc_swz::ASTCENC_SWZ_1;
-    switch (numComponents) {
-        case 4: swizzle.a = astcenc_swz::ASTCENC_SWZ_A;
-        case 3: swizzle.b = astcenc_swz::ASTCENC_SWZ_B;
-        case 2: swizzle.g = astcenc_swz::ASTCENC_SWZ_G;
-        case 1: break;
-            
-        default:
-            error.setErrorMessage("Unsupported number of components");
-            delete [] content;
-            astcenc_context_free(context);
-            callbackContext.reset();
-            return nullptr;
+    return decodeBlockRows(0, 0, _width, _height, componentSize, nullptr, numThreads, error, userInfo, progressCallback, [&](const char* __nonnull pixels, long stripBytesPerRow, long y, long z, long numRows) {
+        // Slices of the output follow each other
+        auto slice = buffer + z * _height * bytesPerRow;
+        for (long row = 0; row < numRows; row++) {
+            packComponents(pixels + row * stripBytesPerRow, slice + (y + row) * bytesPerRow, _width, numComponents, componentSize);
+        }
+    });
+}
+
+
+bool ASTCImage::decompressRegionInto(const ASTCRect& rect, char* __nonnull buffer, long bytesPerRow, long numComponents, long componentSize, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    if (rect.width <= 0 || rect.height <= 0 || rect.x < 0 || rect.y < 0 || rect.x + rect.width > _width || rect.y + rect.height > _height) {
+        error.setErrorMessage("Invalid region");
+        return false;
     }
-#else
-    swizzle.r = astcenc_swz::ASTCENC_SWZ_R;
-    swizzle.g = astcenc_swz::ASTCENC_SWZ_G;
-    swizzle.b = astcenc_swz::ASTCENC_SWZ_B;
-//    swizzle.a = astcenc_swz::ASTCENC_SWZ_A;
-    swizzle.a = astcenc_swz::ASTCENC_SWZ_1;
-#endif
     
+    if (numComponents < 1 || numComponents > 4) {
+        error.setErrorMessage("Unsupported number of components");
+        return false;
+    }
     
-    auto dataLength = _numBlocksWidth * _numBlocksHeight * _numBlocksDepth * 16;
+    auto packedBytesPerRow = rect.width * numComponents * componentSize;
+    if (bytesPerRow == 0) {
+        bytesPerRow = packedBytesPerRow;
+    }
+    else if (bytesPerRow < packedBytesPerRow) {
+        error.setErrorMessage("Invalid bytes per row");
+        return false;
+    }
     
+    // Only block rows overlapping the region are decoded, and of those only the blocks overlapping it
+    return decodeBlockRows(rect.x, rect.y, rect.width, rect.height, componentSize, nullptr, numThreads, error, userInfo, progressCallback, [&](const char* __nonnull pixels, long stripBytesPerRow, long y, long z, long numRows) {
+        // Slices of the region follow each other
+        auto slice = buffer + z * rect.height * bytesPerRow;
+        for (long row = 0; row < numRows; row++) {
+            packComponents(pixels + row * stripBytesPerRow, slice + (y - rect.y + row) * bytesPerRow, rect.width, numComponents, componentSize);
+        }
+    });
+}
+
+
+bool ASTCImage::update(ASTCRawImage* __nonnull image, const ASTCRect* __nonnull rects, long numRects, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    if (image->_width != _width || image->_height != _height || image->_depth != _depth ||
+        image->_originalNumComponents != _originalNumComponents || image->_componentSize != _componentSize ||
+        image->_linear != _linear || image->_hdr != _hdr || image->_normalMap != _normalMap) {
+        error.setErrorMessage("Image doesn't match the compressed image");
+        return false;
+    }
+    
+    if (_blockDepth != 1) {
+        error.setErrorMessage("Images with 3D blocks can't be updated");
+        return false;
+    }
+    
+    if (_releaseCallback) {
+        error.setErrorMessage("Images mapped from a file can't be updated");
+        return false;
+    }
+    
+    // Mark the blocks touched by any of the rectangles in all slices, rectangles may overlap
+    auto numSliceBlocks = _numBlocksWidth * _numBlocksHeight;
+    std::vector<uint8_t> dirtyBlocks(static_cast<size_t>(numSliceBlocks));
+    for (long i = 0; i < numRects; i++) {
+        auto& rect = rects[i];
+        auto minX = std::max(rect.x, 0L);
+        auto minY = std::max(rect.y, 0L);
+        auto maxX = std::min(rect.x + rect.width, _width);
+        auto maxY = std::min(rect.y + rect.height, _height);
+        if (minX >= maxX || minY >= maxY) {
+            continue;
+        }
+        
+        for (auto blockY = minY / _blockHeight; blockY <= (maxY - 1) / _blockHeight; blockY++) {
+            auto row = dirtyBlocks.data() + blockY * _numBlocksWidth;
+            memset(row + minX / _blockWidth, 1, static_cast<size_t>((maxX - 1) / _blockWidth - minX / _blockWidth + 1));
+        }
+    }
     
-    // Decompress image
-    auto compressedData = reinterpret_cast<uint8_t*>(_data);
-    result = astcenc_decompress_image(context, compressedData, dataLength, &image, &swizzle, 0);
+    std::vector<uint32_t> blockIndices;
+    for (long z = 0; z < _numBlocksDepth; z++) {
+        for (long i = 0; i < numSliceBlocks; i++) {
+            if (dirtyBlocks[i]) {
+                blockIndices.push_back(static_cast<uint32_t>(z * numSliceBlocks + i));
+            }
+        }
+    }
+    
+    if (blockIndices.empty()) {
+        return true;
+    }
+    
+    // Statistics of the touched blocks alone can't be merged with the ones of the whole image
+    _blockStatistics = {};
+    return image->compressBlocksInto(_data, _blockWidth, _blockHeight, options, numThreads, blockIndices, error, userInfo, progressCallback);
+}
+
+
+bool ASTCImage::decodeBlockRows(long x, long y, long width, long height, long componentSize, char* __nullable output, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback, const DecodedRowsHandler& handleRows) {
+    // Prepare ASTC encoder config
+    astcenc_config config;
+    auto result = initDecompressionConfig(getProfile(_linear, _hdr, _originalNumComponents), _blockWidth, _blockHeight, _blockDepth, &config);
     if (result != astcenc_error::ASTCENC_SUCCESS) {
-        error.setErrorMessage("Could not decompress image");
-        delete [] content;
-        astcenc_context_free(context);
-        callbackContext.reset();
-        return nullptr;
+        error.setErrorMessage("Could not initialise config");
+        return false;
     }
     
-    // Clean up
-    astcenc_context_free(context);
-    callbackContext.reset();
+    astcenc_type dataType;
+    if (!getImageDataType(componentSize, dataType)) {
+        error.setErrorMessage("Unsupported component size");
+        return false;
+    }
+    
+    auto swizzle = getDecompressionSwizzle(_originalNumComponents, _normalMap);
+    
+    // Blocks overlapping the requested pixels. Blocks of a block row are stored next to each other, so each strip is one contiguous range of compressed data
+    auto firstBlockX = x / _blockWidth;
+    auto lastBlockX = (x + width + _blockWidth - 1) / _blockWidth;
+    auto firstBlockY = y / _blockHeight;
+    auto lastBlockY = (y + height + _blockHeight - 1) / _blockHeight;
+    auto numBlockRows = lastBlockY - firstBlockY;
+    auto numStrips = numBlockRows * _numBlocksDepth;
+    
+    auto pixelSize = 4 * componentSize;
+    auto stripX = firstBlockX * _blockWidth;
+    auto stripWidth = std::min(lastBlockX * _blockWidth, _width) - stripX;
+    auto stripBytesPerRow = stripWidth * pixelSize;
+    
+    // Every worker decodes whole strips with its own single threaded context
+    auto contextNumThreads = resolveNumThreads(numThreads, numStrips);
+    ASTCOperation operation(nullptr, userInfo, progressCallback);
+    std::atomic<long> nextStrip = 0;
+    std::atomic<long> numDecodedStrips = 0;
+    std::atomic<bool> failed = false;
+    std::mutex errorMutex;
+    runOnThreads(contextNumThreads, [&](unsigned int) {
+        auto fail = [&](const char* __nonnull errorMessage) {
+            std::lock_guard lock(errorMutex);
+            if (!failed) {
+                error.setErrorMessage(errorMessage);
+                failed = true;
+            }
+        };
+        
+        astcenc_context* context = nullptr;
+        if (acquireContext(config, 1, &context) != astcenc_error::ASTCENC_SUCCESS) {
+            fail("Could not create context");
+            return;
+        }
+        
+        // A strip of 3D blocks holds one slice per block layer. Strips decoded in place point into the output instead
+        auto stripSliceSize = stripBytesPerRow * _blockHeight;
+        std::vector<char> strip(output ? 0 : stripSliceSize * _blockDepth);
+        auto stripSlices = getImageSlices(strip.data(), stripSliceSize, _blockDepth);
+        astcenc_image image;
+        image.data_type = dataType;
+        image.dim_x = static_cast<unsigned int>(stripWidth);
+        image.data = stripSlices.data();
+        
+        while (!failed && !operation.cancelled) {
+            auto stripIndex = nextStrip++;
+            if (stripIndex >= numStrips) {
+                break;
+            }
+            
+            auto blockZ = stripIndex / numBlockRows;
+            auto blockY = firstBlockY + stripIndex % numBlockRows;
+            auto stripY = blockY * _blockHeight;
+            auto stripHeight = std::min(_blockHeight, _height - stripY);
+            auto stripZ = blockZ * _blockDepth;
+            auto stripDepth = std::min(_blockDepth, _depth - stripZ);
+            image.dim_y = static_cast<unsigned int>(stripHeight);
+            image.dim_z = static_cast<unsigned int>(stripDepth);
+            if (output) {
+                for (long slice = 0; slice < stripDepth; slice++) {
+                    stripSlices[slice] = output + ((stripZ + slice) * _height + stripY) * stripBytesPerRow;
+                }
+            }
+            
+            auto compressedData = reinterpret_cast<const uint8_t*>(_data) + ((blockZ * _numBlocksHeight + blockY) * _numBlocksWidth + firstBlockX) * 16;
+            auto dataLength = (lastBlockX - firstBlockX) * 16;
+            if (astcenc_decompress_image(context, compressedData, dataLength, &image, &swizzle, 0) != astcenc_error::ASTCENC_SUCCESS) {
+                fail("Could not decompress image");
+                break;
+            }
+            
+            // Hand over only the requested part of the strip
+            auto firstRow = std::max(stripY, y);
+            auto lastRow = std::min(stripY + stripHeight, y + height);
+            for (long slice = 0; slice < stripDepth && !output; slice++) {
+                handleRows(static_cast<const char*>(stripSlices[slice]) + (firstRow - stripY) * stripBytesPerRow + (x - stripX) * pixelSize, stripBytesPerRow, firstRow, stripZ + slice, lastRow - firstRow);
+            }
+            
+            auto progress = static_cast<float>(++numDecodedStrips) * 100.0f / static_cast<float>(numStrips);
+            operation.reportProgress(progress);
+        }
+        
+        releaseContext(context);
+    });
+    
+    if (failed) {
+        return false;
+    }
+    
+    if (operation.cancelled) {
+        error.setErrorMessage("Task was cancelled");
+        return false;
+    }
     
-    return new ASTCRawImage(content, _width, _height, _originalNumComponents, _componentSize, _linear, _hdr);
+    return true;
 }
@@ -0,0 +1,317 @@
+//
+//  ASTCEncoderInternal.hpp
+//  ASTCEncoder
+//
+//  Created by agent on 15.10.26.
+//
+
+#ifndef ASTCEncoderInternal_hpp
+#define ASTCEncoderInternal_hpp
+
+#include <astcenc.h>
+#include <ASTCEncoderC.hpp>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+
+
+/// State of a single compression or decompression call.
+///
+/// All worker threads of the call share it, so cancellation requested from any of them is seen by every other one.
+struct ASTCOperation {
+    // Compression context that's cancelled when the callback asks to stop. Not set for decompression, which checks `cancelled` between block rows instead
+    astcenc_context* __nullable context = nullptr;
+    void* __nullable userInfo = nullptr;
+    ASTCEncoderProgressCallback __nullable callback = nullptr;
+    
+    // Task was cancelled during compression
+    std::atomic<bool> cancelled = false;
+    
+    // astcenc may report progress from several threads, the callback is never executed concurrently
+    std::mutex callbackMutex;
+    
+    ASTCOperation(astcenc_context* __nullable context, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable callback):
+    context(context),
+    userInfo(userInfo),
+    callback(callback) {
+        // Done
+    }
+    
+    /// Forwards `progress` to the callback and sets `cancelled` if the callback asks to stop. A running compression is cancelled right away.
+    void reportProgress(float progress);
+};
+
+
+/// Operation the calling thread currently works on.
+///
+/// astcenc's progress callback doesn't take a user pointer, so each worker thread publishes its operation here while it's inside astcenc.
+extern thread_local ASTCOperation* __nullable currentOperation;
+
+
+/// Sets ``currentOperation`` of the calling thread for the lifetime of the scope.
+class ASTCOperationScope final {
+private:
+    ASTCOperation* __nullable _previousOperation;
+    
+public:
+    ASTCOperationScope(ASTCOperation* __nonnull operation):
+    _previousOperation(currentOperation) {
+        currentOperation = operation;
+    }
+    
+    ~ASTCOperationScope() {
+        currentOperation = _previousOperation;
+    }
+    
+    ASTCOperationScope(const ASTCOperationScope&) = delete;
+    ASTCOperationScope& operator = (const ASTCOperationScope&) = delete;
+};
+
+
+/// Pointers to `depth` slices of `bytesPerSlice` bytes that follow each other, as ``astcenc_image`` expects them.
+inline std::vector<void*> getImageSlices(char* __nonnull data, long bytesPerSlice, long depth) {
+    std::vector<void*> slices(depth);
+    for (long z = 0; z < depth; z++) {
+        slices[z] = data + z * bytesPerSlice;
+    }
+    return slices;
+}
+
+
+/// Resolves the number of threads to use for processing `numBlocks` ASTC blocks.
+///
+/// A non-positive `numThreads` value selects one thread per hardware core. The result is never larger than the number of blocks, since extra threads would have nothing to do.
+inline unsigned int resolveNumThreads(long numThreads, long numBlocks) {
+    if (numThreads < 1) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    return static_cast<unsigned int>(std::clamp(numThreads, 1L, std::max(numBlocks, 1L)));
+}
+
+
+/// Runs `task` on `numThreads` threads and waits for all of them to finish.
+///
+/// The calling thread takes part in the work as the thread with index `0`. Nothing runs if `numThreads` is `0`.
+template <typename Task>
+void runOnThreads(unsigned int numThreads, const Task& task) {
+    if (numThreads == 0) {
+        return;
+    }
+    
+    std::vector<std::thread> workers;
+    workers.reserve(numThreads - 1);
+    for (unsigned int threadIndex = 1; threadIndex < numThreads; threadIndex++) {
+        workers.emplace_back([&task, threadIndex]() {
+            task(threadIndex);
+        });
+    }
+    
+    task(0u);
+    
+    for (auto& worker: workers) {
+        worker.join();
+    }
+}
+
+
+/// Checks the size and pixel format of an uncompressed image. Sets `error` and returns `false` if the encoder can't take the image.
+bool validateImageFormat(long width, long height, long numComponents, long componentSize, bool hdr, ASTCErrorInfo& error);
+
+/// Returns the astcenc colour profile for an image's colour space.
+///
+/// Non-linear LDR images are encoded as sRGB. HDR images with an alpha channel keep alpha in the LDR range, the way it's used for coverage and masks.
+astcenc_profile getProfile(bool linear, bool hdr, long numComponents);
+
+/// Initialises `config` for compressing images of the given profile with the given block size and encoder settings.
+///
+/// Component weights follow `numComponents`, components the image doesn't have don't count. `flags` are passed on to astcenc together with the flags of `options`. The progress callback of the config forwards progress to the ``currentOperation`` of the reporting thread.
+astcenc_error initCompressionConfig(astcenc_profile profile, long numComponents, unsigned int flags, long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, astcenc_config* __nonnull config);
+
+/// Initialises `config` for decompressing images of the given profile with the given block size.
+astcenc_error initDecompressionConfig(astcenc_profile profile, long blockWidth, long blockHeight, long blockDepth, astcenc_config* __nonnull config);
+
+
+/// Converts an IEEE half precision value to a float.
+inline float halfToFloat(uint16_t value) {
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F) {
+        // Infinity and NaN
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    else if (mantissa == 0) {
+        bits = sign;
+    }
+    else {
+        // Subnormal half values are normal floats
+        exponent = 113;
+        while ((mantissa & 0x400) == 0) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    }
+    
+    float result;
+    memcpy(&result, &bits, 4);
+    return result;
+}
+
+
+/// Converts a float to the nearest IEEE half precision value.
+inline uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 112;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    
+    if (((bits >> 23) & 0xFF) == 0xFF) {
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+    }
+    
+    if (exponent >= 0x1F) {
+        return sign | 0x7C00;
+    }
+    
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return sign;
+        }
+        
+        // Subnormal result, round to nearest
+        mantissa |= 0x800000;
+        auto shift = static_cast<uint32_t>(14 - exponent);
+        auto halfMantissa = mantissa >> shift;
+        auto remainder = mantissa & ((1u << shift) - 1);
+        auto halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (halfMantissa & 1))) {
+            halfMantissa++;
+        }
+        return sign | static_cast<uint16_t>(halfMantissa);
+    }
+    
+    // Round to nearest even, a carry into the exponent is intended
+    uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    auto remainder = mantissa & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+        half++;
+    }
+    return sign | static_cast<uint16_t>(std::min(half, 0x7C00u));
+}
+
+
+/// Expands `numPixels` pixels of `numComponents` components to the 4 component layout the encoder works with.
+///
+/// The source components are kept in place and the missing ones are set to `1`. Uses NEON on ARM and SSSE3 or AVX2 on x86.
+void expandComponents(const char* __nonnull src, char* __nonnull dst, long numPixels, long numComponents, long componentSize);
+
+/// Packs `numPixels` 4 component pixels into pixels of the first `numComponents` components. The reverse of ``expandComponents``.
+void packComponents(const char* __nonnull src, char* __nonnull dst, long numPixels, long numComponents, long componentSize);
+
+/// Reference implementation of ``expandComponents``, also handles the tails the vector kernels leave over.
+void expandComponentsScalar(const char* __nonnull src, char* __nonnull dst, long numPixels, long numComponents, long componentSize);
+
+/// Reference implementation of ``packComponents``, also handles the tails the vector kernels leave over.
+void packComponentsScalar(const char* __nonnull src, char* __nonnull dst, long numPixels, long numComponents, long componentSize);
+
+
+// MARK: - Constant blocks
+
+/// Size in bytes of a component of an astcenc image.
+inline long getComponentSize(astcenc_type dataType) {
+    switch (dataType) {
+        case astcenc_type::ASTCENC_TYPE_U8: return 1;
+        case astcenc_type::ASTCENC_TYPE_F16: return 2;
+        default: return 4;
+    }
+}
+
+/// Writes the blocks of `blockIndices` whose texels all have the same colour to `blocks` as void extent blocks, and removes them from `blockIndices`.
+///
+/// Blocks are compared row by row with NEON on ARM and SSE2 on x86, spread across `numThreads` threads. Only for 2D blocks of LDR images.
+void encodeConstantBlocks(const astcenc_image& image, const astcenc_swizzle& swizzle, long blockWidth, long blockHeight, unsigned int numThreads, uint8_t* __nonnull blocks, std::vector<uint32_t>& blockIndices);
+
+/// Copies the texels of block `blockIndex` of a 2D block size to `destination`, whose rows are `destinationBytesPerRow` bytes apart.
+///
+/// Blocks that stick out of the image repeat its edge, the way astcenc sees them.
+void copyBlock(const astcenc_image& image, long blockWidth, long blockHeight, long blockIndex, char* __nonnull destination, long destinationBytesPerRow);
+
+/// Copies the blocks `blockIndices` of `image` next to each other into `packedData`, `packedBlocksWidth` blocks per row.
+///
+/// Every packed block compresses exactly like it does in place, see ``copyBlock``.
+void packBlocks(const astcenc_image& image, long blockWidth, long blockHeight, const std::vector<uint32_t>& blockIndices, long packedBlocksWidth, char* __nonnull packedData);
+
+
+// MARK: - Block deduplication
+
+/// XXH64 of `length` bytes with a seed of `0`.
+uint64_t hashBytes(const char* __nonnull bytes, size_t length);
+
+/// Block whose texels repeat another block of the image.
+struct ASTCDuplicateBlock {
+    uint32_t blockIndex;
+    
+    /// Block whose encoding is reused.
+    uint32_t originalBlockIndex;
+};
+
+/// Removes blocks whose texels repeat an earlier block of `blockIndices` and lists them in `duplicateBlocks`.
+///
+/// Blocks are hashed with XXH64 on `numThreads` threads. Blocks with the same hash are compared texel by texel before they count as duplicates, so hash collisions never mix up encodings.
+void removeDuplicateBlocks(const astcenc_image& image, long blockWidth, long blockHeight, unsigned int numThreads, std::vector<uint32_t>& blockIndices, std::vector<ASTCDuplicateBlock>& duplicateBlocks);
+
+
+// MARK: - Files
+
+/// Read-only view of a whole file mapped into memory.
+///
+/// Pages are mapped copy-on-write, so images built on top of the mapping can be modified without touching the file. Several images may share one mapping, it's unmapped once the last of them is released.
+struct ASTCFileMapping {
+    std::atomic<size_t> referenceCounter = 1;
+    char* __nonnull data;
+    size_t size;
+    
+    ASTCFileMapping(char* __nonnull data, size_t size):
+    data(data),
+    size(size) {
+        // Done
+    }
+};
+
+/// Maps the file at `path`. Returns `nullptr` and sets `error` if the file could not be opened or is empty.
+ASTCFileMapping* __nullable mapFile(const char* __nonnull path, ASTCErrorInfo& error);
+
+void retainFileMapping(ASTCFileMapping* __nonnull mapping);
+
+/// ``ASTCReleaseCallback`` for data inside of a file mapping, pass the mapping as user info.
+void releaseFileMapping(void* __nullable mapping, void* __nonnull data);
+
+
+// MARK: - Context pool
+
+/// Whether contexts allocated with `a` and `b` behave the same.
+///
+/// The astcenc config already contains everything derived from the profile, block dimensions, quality, component weights and flags.
+bool isSameConfig(const astcenc_config& a, const astcenc_config& b);
+
+/// Takes a context matching `config` and `numThreads` out of the shared context pool.
+///
+/// A new context is allocated if the pool has no idle context with this configuration. The context must be handed back with ``releaseContext`` instead of `astcenc_context_free`.
+astcenc_error acquireContext(const astcenc_config& config, unsigned int numThreads, astcenc_context* __nullable * __nonnull context);
+
+/// Resets `context` and returns it to the shared context pool.
+///
+/// The least recently used idle contexts are freed if the pool exceeds its capacity.
+void releaseContext(astcenc_context* __nullable context);
+
+
+#endif // ASTCEncoderInternal_hpp
@@ -0,0 +1,268 @@
+//
+//  ASTCFile.cpp
+//  ASTCEncoder
+//
+//  Created by agent on 15.10.26.
+//
+
+#include "ASTCEncoderInternal.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// MARK: - File mapping
+
+ASTCFileMapping* __nullable mapFile(const char* __nonnull path, ASTCErrorInfo& error) {
+    auto file = open(path, O_RDONLY);
+    if (file < 0) {
+        error.setErrorMessage("Could not open file");
+        return nullptr;
+    }
+    
+    struct stat fileInfo;
+    if (fstat(file, &fileInfo) != 0 || fileInfo.st_size <= 0) {
+        close(file);
+        error.setErrorMessage("File is empty");
+        return nullptr;
+    }
+    
+    // The mapping stays valid after the descriptor is closed
+    auto size = static_cast<size_t>(fileInfo.st_size);
+    auto data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+        error.setErrorMessage("Could not map file");
+        return nullptr;
+    }
+    
+    return new ASTCFileMapping(static_cast<char*>(data), size);
+}
+
+
+void retainFileMapping(ASTCFileMapping* __nonnull mapping) {
+    mapping->referenceCounter.fetch_add(1);
+}
+
+
+void releaseFileMapping(void* __nullable userInfo, void* __nonnull) {
+    auto mapping = static_cast<ASTCFileMapping*>(userInfo);
+    if (mapping && mapping->referenceCounter.fetch_sub(1) <= 1) {
+        munmap(mapping->data, mapping->size);
+        delete mapping;
+    }
+}
+
+
+// MARK: - .astc header
+
+#define ASTC_FILE_MAGIC 0x5CA1AB13
+#define ASTC_FILE_HEADER_SIZE 16
+#define ASTC_FILE_MAX_DIMENSION 0xFFFFFF
+
+
+/// Header of an `.astc` file. Image dimensions are stored as 24 bit little endian values.
+struct ASTCFileHeader {
+    uint8_t magic[4];
+    uint8_t blockWidth;
+    uint8_t blockHeight;
+    uint8_t blockDepth;
+    uint8_t width[3];
+    uint8_t height[3];
+    uint8_t depth[3];
+};
+static_assert(sizeof(ASTCFileHeader) == ASTC_FILE_HEADER_SIZE, "Unexpected .astc header size");
+
+
+static void storeFileValue(uint8_t* __nonnull bytes, long numBytes, uint32_t value) {
+    for (long i = 0; i < numBytes; i++) {
+        bytes[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+
+static uint32_t loadFileValue(const uint8_t* __nonnull bytes, long numBytes) {
+    uint32_t value = 0;
+    for (long i = 0; i < numBytes; i++) {
+        value |= static_cast<uint32_t>(bytes[i]) << (i * 8);
+    }
+    return value;
+}
+
+
+static bool makeFileHeader(long blockWidth, long blockHeight, long blockDepth, long width, long height, long depth, ASTCFileHeader& header, ASTCErrorInfo& error) {
+    if (width > ASTC_FILE_MAX_DIMENSION || height > ASTC_FILE_MAX_DIMENSION || depth > ASTC_FILE_MAX_DIMENSION) {
+        error.setErrorMessage("Image is too large for .astc file");
+        return false;
+    }
+    
+    storeFileValue(header.magic, 4, ASTC_FILE_MAGIC);
+    header.blockWidth = static_cast<uint8_t>(blockWidth);
+    header.blockHeight = static_cast<uint8_t>(blockHeight);
+    header.blockDepth = static_cast<uint8_t>(blockDepth);
+    storeFileValue(header.width, 3, static_cast<uint32_t>(width));
+    storeFileValue(header.height, 3, static_cast<uint32_t>(height));
+    storeFileValue(header.depth, 3, static_cast<uint32_t>(depth));
+    return true;
+}
+
+
+// MARK: - Reading
+
+ASTCImage* __nullable ASTCImage::load(const char* __nonnull path, long numComponents, long componentSize, bool linear, bool hdr, ASTCErrorInfo& error) {
+    if (numComponents < 1 || numComponents > 4) {
+        error.setErrorMessage("Unsupported number of components");
+        return nullptr;
+    }
+    
+    if (componentSize != 1 && componentSize != 2 && componentSize != 4) {
+        error.setErrorMessage("Unsupported component size");
+        return nullptr;
+    }
+    
+    auto mapping = mapFile(path, error);
+    if (mapping == nullptr) {
+        return nullptr;
+    }
+    
+    auto fail = [&](const char* __nonnull errorMessage) -> ASTCImage* {
+        error.setErrorMessage(errorMessage);
+        releaseFileMapping(mapping, mapping->data);
+        return nullptr;
+    };
+    
+    if (mapping->size < ASTC_FILE_HEADER_SIZE) {
+        return fail("Invalid .astc file");
+    }
+    
+    ASTCFileHeader header;
+    memcpy(&header, mapping->data, ASTC_FILE_HEADER_SIZE);
+    if (loadFileValue(header.magic, 4) != ASTC_FILE_MAGIC) {
+        return fail("Invalid .astc file");
+    }
+    
+    // Let astcenc decide whether the block size is valid
+    long blockWidth = header.blockWidth;
+    long blockHeight = header.blockHeight;
+    long blockDepth = header.blockDepth;
+    astcenc_config config;
+    if (initDecompressionConfig(getProfile(linear, hdr, numComponents), blockWidth, blockHeight, blockDepth, &config) != astcenc_error::ASTCENC_SUCCESS) {
+        return fail("Unsupported block size");
+    }
+    
+    long width = loadFileValue(header.width, 3);
+    long height = loadFileValue(header.height, 3);
+    long depth = loadFileValue(header.depth, 3);
+    if (width == 0 || height == 0 || depth == 0) {
+        return fail("Invalid image size");
+    }
+    
+    auto numBlocksWidth = (width + blockWidth - 1) / blockWidth;
+    auto numBlocksHeight = (height + blockHeight - 1) / blockHeight;
+    auto numBlocksDepth = (depth + blockDepth - 1) / blockDepth;
+    
+    // The product of the 24 bit sizes can overflow, so the block counts are checked one by one against the blocks the file holds
+    auto numFileBlocks = static_cast<long>((mapping->size - ASTC_FILE_HEADER_SIZE) / 16);
+    if (numBlocksWidth > numFileBlocks || numBlocksHeight > numFileBlocks / numBlocksWidth ||
+        numBlocksDepth > numFileBlocks / (numBlocksWidth * numBlocksHeight)) {
+        return fail("File is truncated");
+    }
+    
+    // The image takes over the reference to the mapping
+    return new ASTCImage(mapping->data + ASTC_FILE_HEADER_SIZE, width, height, depth, numComponents, componentSize, linear, hdr,
+                         numBlocksWidth, numBlocksHeight, numBlocksDepth, blockWidth, blockHeight, blockDepth,
+                         mapping, releaseFileMapping);
+}
+
+
+// MARK: - Writing
+
+bool ASTCImage::write(const char* __nonnull path, ASTCErrorInfo& error) {
+    ASTCFileHeader header;
+    if (!makeFileHeader(_blockWidth, _blockHeight, _blockDepth, _width, _height, _depth, header, error)) {
+        return false;
+    }
+    
+    auto file = fopen(path, "wb");
+    if (file == nullptr) {
+        error.setErrorMessage("Could not create file");
+        return false;
+    }
+    
+    // Blocks are written straight from the image
+    auto dataLength = static_cast<size_t>(getDataSize());
+    auto success = fwrite(&header, ASTC_FILE_HEADER_SIZE, 1, file) == 1 && fwrite(_data, 1, dataLength, file) == dataLength;
+    success = fclose(file) == 0 && success;
+    if (!success) {
+        error.setErrorMessage("Could not write file");
+        remove(path);
+        return false;
+    }
+    
+    return true;
+}
+
+
+bool ASTCRawImage::compressToFile(const char* __nonnull path, long blockWidth, long blockHeight, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    return compressToFile(path, blockWidth, blockHeight, 1, ASTCCompressionOptions { .quality = quality }, numThreads, error, userInfo, progressCallback);
+}
+
+
+bool ASTCRawImage::compressToFile(const char* __nonnull path, long blockWidth, long blockHeight, long blockDepth, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    return compressToFile(path, blockWidth, blockHeight, blockDepth, ASTCCompressionOptions { .quality = quality }, numThreads, error, userInfo, progressCallback);
+}
+
+
+bool ASTCRawImage::compressToFile(const char* __nonnull path, long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    auto dataLength = getCompressedDataSize(blockWidth, blockHeight, blockDepth);
+    if (dataLength == 0) {
+        error.setErrorMessage("Unsupported block size");
+        return false;
+    }
+    
+    ASTCFileHeader header;
+    if (!makeFileHeader(blockWidth, blockHeight, blockDepth, _width, _height, _depth, header, error)) {
+        return false;
+    }
+    
+    auto file = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) {
+        error.setErrorMessage("Could not create file");
+        return false;
+    }
+    
+    auto fail = [&](const char* __nullable errorMessage) {
+        if (errorMessage) {
+            error.setErrorMessage(errorMessage);
+        }
+        close(file);
+        unlink(path);
+        return false;
+    };
+    
+    auto fileSize = static_cast<size_t>(ASTC_FILE_HEADER_SIZE + dataLength);
+    if (ftruncate(file, static_cast<off_t>(fileSize)) != 0) {
+        return fail("Could not write file");
+    }
+    
+    auto mappedData = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (mappedData == MAP_FAILED) {
+        return fail("Could not map file");
+    }
+    
+    // The encoder writes blocks directly into the file's pages
+    auto fileData = static_cast<char*>(mappedData);
+    memcpy(fileData, &header, ASTC_FILE_HEADER_SIZE);
+    auto success = compressInto(fileData + ASTC_FILE_HEADER_SIZE, dataLength, blockWidth, blockHeight, blockDepth, options, numThreads, error, userInfo, progressCallback);
+    munmap(mappedData, fileSize);
+    if (!success) {
+        // compressInto already described the error
+        return fail(nullptr);
+    }
+    
+    close(file);
+    return true;
+}
@@ -0,0 +1,388 @@
+//
+//  ASTCMipmaps.cpp
+//  ASTCEncoder
+//
+//  Created by agent on 15.10.26.
+//
+
+#include "ASTCEncoderInternal.hpp"
+#include <string.h>
+#include <math.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// MARK: - Pixel vectors
+
+// Mip levels are filtered as 4 component float pixels, one pixel fits into one SIMD register
+
+#if defined(__ARM_NEON)
+
+typedef float32x4_t ASTCPixel;
+
+static inline ASTCPixel loadPixel(const float* __nonnull pixel) { return vld1q_f32(pixel); }
+static inline void storePixel(float* __nonnull pixel, ASTCPixel value) { vst1q_f32(pixel, value); }
+static inline ASTCPixel zeroPixel() { return vdupq_n_f32(0); }
+static inline ASTCPixel addPixels(ASTCPixel a, ASTCPixel b) { return vaddq_f32(a, b); }
+static inline ASTCPixel scalePixel(ASTCPixel a, float weight) { return vmulq_n_f32(a, weight); }
+static inline ASTCPixel addScaledPixel(ASTCPixel sum, ASTCPixel a, float weight) { return vmlaq_n_f32(sum, a, weight); }
+
+#elif defined(__SSE2__)
+
+typedef __m128 ASTCPixel;
+
+static inline ASTCPixel loadPixel(const float* __nonnull pixel) { return _mm_loadu_ps(pixel); }
+static inline void storePixel(float* __nonnull pixel, ASTCPixel value) { _mm_storeu_ps(pixel, value); }
+static inline ASTCPixel zeroPixel() { return _mm_setzero_ps(); }
+static inline ASTCPixel addPixels(ASTCPixel a, ASTCPixel b) { return _mm_add_ps(a, b); }
+static inline ASTCPixel scalePixel(ASTCPixel a, float weight) { return _mm_mul_ps(a, _mm_set1_ps(weight)); }
+static inline ASTCPixel addScaledPixel(ASTCPixel sum, ASTCPixel a, float weight) { return _mm_add_ps(sum, _mm_mul_ps(a, _mm_set1_ps(weight))); }
+
+#else
+
+struct ASTCPixel {
+    float v[4];
+};
+
+static inline ASTCPixel loadPixel(const float* __nonnull pixel) { ASTCPixel value; memcpy(value.v, pixel, sizeof(value.v)); return value; }
+static inline void storePixel(float* __nonnull pixel, ASTCPixel value) { memcpy(pixel, value.v, sizeof(value.v)); }
+static inline ASTCPixel zeroPixel() { return ASTCPixel { { 0, 0, 0, 0 } }; }
+static inline ASTCPixel addPixels(ASTCPixel a, ASTCPixel b) { return ASTCPixel { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+static inline ASTCPixel scalePixel(ASTCPixel a, float weight) { return ASTCPixel { { a.v[0] * weight, a.v[1] * weight, a.v[2] * weight, a.v[3] * weight } }; }
+static inline ASTCPixel addScaledPixel(ASTCPixel sum, ASTCPixel a, float weight) { return addPixels(sum, scalePixel(a, weight)); }
+
+#endif
+
+
+// MARK: - Component conversion
+
+/// sRGB encoded 8 bit values decoded to linear floats.
+static const float* __nonnull getSRGBDecodingTable() {
+    static const auto table = [] {
+        std::vector<float> values(256);
+        for (long i = 0; i < 256; i++) {
+            auto value = static_cast<float>(i) / 255.0f;
+            values[i] = value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+
+#define ASTC_SRGB_ENCODING_TABLE_SIZE 4096
+
+/// Linear floats sampled in `ASTC_SRGB_ENCODING_TABLE_SIZE` steps encoded to sRGB 8 bit values.
+static const uint8_t* __nonnull getSRGBEncodingTable() {
+    static const auto table = [] {
+        std::vector<uint8_t> values(ASTC_SRGB_ENCODING_TABLE_SIZE);
+        for (long i = 0; i < ASTC_SRGB_ENCODING_TABLE_SIZE; i++) {
+            auto value = static_cast<float>(i) / static_cast<float>(ASTC_SRGB_ENCODING_TABLE_SIZE - 1);
+            auto encoded = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+            values[i] = static_cast<uint8_t>(lroundf(std::clamp(encoded, 0.0f, 1.0f) * 255.0f));
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+
+/// Converts a row of 4 component pixels to floats. sRGB color components are decoded, so the filters work on linear values. The alpha component is always linear.
+static void convertRowToFloat(const char* __nonnull src, float* __nonnull dst, long width, long componentSize, bool srgb, long alphaComponent) {
+    auto numValues = width * 4;
+    switch (componentSize) {
+        case 1: {
+            auto values = reinterpret_cast<const uint8_t*>(src);
+            auto decodingTable = getSRGBDecodingTable();
+            for (long i = 0; i < numValues; i++) {
+                dst[i] = srgb && (i & 3) != alphaComponent ? decodingTable[values[i]] : static_cast<float>(values[i]) / 255.0f;
+            }
+            break;
+        }
+        case 2: {
+            auto values = reinterpret_cast<const uint16_t*>(src);
+            for (long i = 0; i < numValues; i++) {
+                dst[i] = halfToFloat(values[i]);
+            }
+            break;
+        }
+        default: {
+            memcpy(dst, src, numValues * sizeof(float));
+            break;
+        }
+    }
+}
+
+
+static void convertRowFromFloat(const float* __nonnull src, char* __nonnull dst, long width, long componentSize, bool srgb, long alphaComponent) {
+    auto numValues = width * 4;
+    switch (componentSize) {
+        case 1: {
+            auto values = reinterpret_cast<uint8_t*>(dst);
+            auto encodingTable = getSRGBEncodingTable();
+            for (long i = 0; i < numValues; i++) {
+                auto value = std::clamp(src[i], 0.0f, 1.0f);
+                if (srgb && (i & 3) != alphaComponent) {
+                    values[i] = encodingTable[lroundf(value * static_cast<float>(ASTC_SRGB_ENCODING_TABLE_SIZE - 1))];
+                }
+                else {
+                    values[i] = static_cast<uint8_t>(lroundf(value * 255.0f));
+                }
+            }
+            break;
+        }
+        case 2: {
+            auto values = reinterpret_cast<uint16_t*>(dst);
+            for (long i = 0; i < numValues; i++) {
+                values[i] = floatToHalf(src[i]);
+            }
+            break;
+        }
+        default: {
+            memcpy(dst, src, numValues * sizeof(float));
+            break;
+        }
+    }
+}
+
+
+// MARK: - Filters
+
+/// Runs `processRow` for rows `0 ..< numRows` on `numThreads` threads.
+template<typename Task>
+static void forEachRow(long numRows, long numThreads, const Task& processRow) {
+    std::atomic<long> nextRow = 0;
+    runOnThreads(resolveNumThreads(numThreads, numRows), [&](unsigned int) {
+        for (auto row = nextRow++; row < numRows; row = nextRow++) {
+            processRow(row);
+        }
+    });
+}
+
+
+/// Averages 2x2 pixels. The last row or column of odd sized levels is repeated.
+static void downsampleBox(const float* __nonnull src, long srcWidth, long srcHeight, float* __nonnull dst, long dstWidth, long dstHeight, long numThreads) {
+    forEachRow(dstHeight, numThreads, [&](long y) {
+        auto row0 = src + std::min(y * 2, srcHeight - 1) * srcWidth * 4;
+        auto row1 = src + std::min(y * 2 + 1, srcHeight - 1) * srcWidth * 4;
+        auto dstRow = dst + y * dstWidth * 4;
+        for (long x = 0; x < dstWidth; x++) {
+            auto x0 = std::min(x * 2, srcWidth - 1) * 4;
+            auto x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+            auto sum = addPixels(addPixels(loadPixel(row0 + x0), loadPixel(row0 + x1)),
+                                 addPixels(loadPixel(row1 + x0), loadPixel(row1 + x1)));
+            storePixel(dstRow + x * 4, scalePixel(sum, 0.25f));
+        }
+    });
+}
+
+
+#define ASTC_KAISER_ALPHA 4.0f
+#define ASTC_KAISER_RADIUS 2.0f
+
+
+/// Zeroth order modified Bessel function of the first kind.
+static float besselI0(float x) {
+    float sum = 1;
+    float term = 1;
+    auto halfX = x * 0.5f;
+    for (long k = 1; k < 32; k++) {
+        term *= (halfX / static_cast<float>(k)) * (halfX / static_cast<float>(k));
+        sum += term;
+        if (term < sum * 1e-8f) {
+            break;
+        }
+    }
+    return sum;
+}
+
+
+static float kaiserWindowedSinc(float x) {
+    auto t = x / ASTC_KAISER_RADIUS;
+    if (fabsf(t) >= 1) {
+        return 0;
+    }
+    
+    auto sinc = x == 0 ? 1.0f : sinf(static_cast<float>(M_PI) * x) / (static_cast<float>(M_PI) * x);
+    return sinc * besselI0(ASTC_KAISER_ALPHA * sqrtf(1 - t * t)) / besselI0(ASTC_KAISER_ALPHA);
+}
+
+
+/// Source taps of every destination pixel along one axis.
+struct ASTCFilterTaps {
+    std::vector<long> first;
+    std::vector<long> count;
+    std::vector<float> weights;
+    long maxCount;
+};
+
+
+static ASTCFilterTaps makeKaiserTaps(long srcSize, long dstSize) {
+    ASTCFilterTaps taps;
+    auto scale = static_cast<float>(srcSize) / static_cast<float>(dstSize);
+    auto support = ASTC_KAISER_RADIUS * scale;
+    taps.maxCount = static_cast<long>(ceilf(support * 2)) + 1;
+    taps.first.resize(dstSize);
+    taps.count.resize(dstSize);
+    taps.weights.resize(dstSize * taps.maxCount);
+    
+    for (long i = 0; i < dstSize; i++) {
+        auto center = (static_cast<float>(i) + 0.5f) * scale;
+        auto first = static_cast<long>(floorf(center - support));
+        auto weights = taps.weights.data() + i * taps.maxCount;
+        
+        // Taps outside of the image are clamped to the edge pixels
+        float sum = 0;
+        long count = 0;
+        for (long j = first; j < first + taps.maxCount; j++) {
+            auto weight = kaiserWindowedSinc((static_cast<float>(j) + 0.5f - center) / scale);
+            weights[count++] = weight;
+            sum += weight;
+        }
+        for (long j = 0; j < count; j++) {
+            weights[j] /= sum;
+        }
+        
+        taps.first[i] = first;
+        taps.count[i] = count;
+    }
+    
+    return taps;
+}
+
+
+/// Separable Kaiser windowed sinc filter, sharper than the box filter without visible ringing.
+static void downsampleKaiser(const float* __nonnull src, long srcWidth, long srcHeight, float* __nonnull dst, long dstWidth, long dstHeight, long numThreads) {
+    auto horizontalTaps = makeKaiserTaps(srcWidth, dstWidth);
+    auto verticalTaps = makeKaiserTaps(srcHeight, dstHeight);
+    
+    // Filter rows first, then columns of the horizontally filtered image
+    std::vector<float> horizontal(dstWidth * srcHeight * 4);
+    forEachRow(srcHeight, numThreads, [&](long y) {
+        auto srcRow = src + y * srcWidth * 4;
+        auto dstRow = horizontal.data() + y * dstWidth * 4;
+        for (long x = 0; x < dstWidth; x++) {
+            auto weights = horizontalTaps.weights.data() + x * horizontalTaps.maxCount;
+            auto sum = zeroPixel();
+            for (long tap = 0; tap < horizontalTaps.count[x]; tap++) {
+                auto srcX = std::clamp(horizontalTaps.first[x] + tap, 0L, srcWidth - 1);
+                sum = addScaledPixel(sum, loadPixel(srcRow + srcX * 4), weights[tap]);
+            }
+            storePixel(dstRow + x * 4, sum);
+        }
+    });
+    
+    forEachRow(dstHeight, numThreads, [&](long y) {
+        auto weights = verticalTaps.weights.data() + y * verticalTaps.maxCount;
+        auto dstRow = dst + y * dstWidth * 4;
+        for (long x = 0; x < dstWidth; x++) {
+            auto sum = zeroPixel();
+            for (long tap = 0; tap < verticalTaps.count[y]; tap++) {
+                auto srcY = std::clamp(verticalTaps.first[y] + tap, 0L, srcHeight - 1);
+                sum = addScaledPixel(sum, loadPixel(horizontal.data() + (srcY * dstWidth + x) * 4), weights[tap]);
+            }
+            storePixel(dstRow + x * 4, sum);
+        }
+    });
+}
+
+
+// MARK: - Mipmaps
+
+long ASTCRawImage::getNumberOfMipmapLevels() {
+    long numLevels = 1;
+    for (auto size = std::max(_width, _height); size > 1; size >>= 1) {
+        numLevels++;
+    }
+    return numLevels;
+}
+
+
+ASTCTexture* __nullable ASTCRawImage::compressMipmaps(long numLevels, ASTCMipmapFilter filter, long blockWidth, long blockHeight, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    return compressMipmaps(numLevels, filter, blockWidth, blockHeight, ASTCCompressionOptions { .quality = quality }, numThreads, error, userInfo, progressCallback);
+}
+
+
+ASTCTexture* __nullable ASTCRawImage::compressMipmaps(long numLevels, ASTCMipmapFilter filter, long blockWidth, long blockHeight, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    if (_depth != 1) {
+        error.setErrorMessage("Mipmaps of 3D images are not supported");
+        return nullptr;
+    }
+    
+    auto maxNumLevels = getNumberOfMipmapLevels();
+    if (numLevels <= 0) {
+        numLevels = maxNumLevels;
+    }
+    else if (numLevels > maxNumLevels) {
+        error.setErrorMessage("Too many mipmap levels");
+        return nullptr;
+    }
+    
+    // Every level goes to the scheduler as soon as it's filtered, the first one is the image itself
+    auto scheduler = ASTCCompressionScheduler::create(numThreads);
+    auto success = scheduler->addImage(this, blockWidth, blockHeight, options, error);
+    
+    // Filter in linear float space, each level is computed from the previous one
+    auto srgb = !_linear && !_hdr;
+    // Greyscale images keep alpha in the second component
+    auto alphaComponent = _originalNumComponents == 2 ? 1 : 3;
+    auto width = _width;
+    auto height = _height;
+    std::vector<float> level;
+    if (success && numLevels > 1) {
+        level.resize(width * height * 4);
+        forEachRow(height, numThreads, [&](long y) {
+            convertRowToFloat(_data + y * width * 4 * _componentSize, level.data() + y * width * 4, width, _componentSize, srgb, alphaComponent);
+        });
+    }
+    
+    std::vector<float> nextLevel;
+    for (long levelIndex = 1; levelIndex < numLevels && success; levelIndex++) {
+        auto nextWidth = std::max(1L, width >> 1);
+        auto nextHeight = std::max(1L, height >> 1);
+        nextLevel.resize(nextWidth * nextHeight * 4);
+        switch (filter) {
+            case ASTCMipmapFilter::box:
+                downsampleBox(level.data(), width, height, nextLevel.data(), nextWidth, nextHeight, numThreads);
+                break;
+            
+            case ASTCMipmapFilter::kaiser:
+                downsampleKaiser(level.data(), width, height, nextLevel.data(), nextWidth, nextHeight, numThreads);
+                break;
+        }
+        
+        // Converted straight into the encoder input of the level
+        auto bytesPerRow = nextWidth * 4 * _componentSize;
+        auto levelData = new char[bytesPerRow * nextHeight];
+        forEachRow(nextHeight, numThreads, [&](long y) {
+            convertRowFromFloat(nextLevel.data() + y * nextWidth * 4, levelData + y * bytesPerRow, nextWidth, _componentSize, srgb, alphaComponent);
+        });
+        
+        auto levelImage = new ASTCRawImage(levelData, nextWidth, nextHeight, 1, _originalNumComponents, _componentSize, _linear, _hdr);
+        levelImage->_normalMap = _normalMap;
+        success = scheduler->addImage(levelImage, blockWidth, blockHeight, options, error);
+        ASTCRawImageRelease(levelImage);
+        
+        std::swap(level, nextLevel);
+        width = nextWidth;
+        height = nextHeight;
+    }
+    
+    // Compress all levels side by side
+    ASTCTexture* texture = nullptr;
+    if (success && scheduler->run(error, userInfo, progressCallback)) {
+        texture = ASTCTexture::create(numLevels, 1, 1, error);
+        for (long levelIndex = 0; levelIndex < numLevels && texture; levelIndex++) {
+            auto compressedImage = scheduler->getCompressedImage(levelIndex);
+            texture->setImage(levelIndex, 0, 0, compressedImage, error);
+            ASTCImageRelease(compressedImage);
+        }
+    }
+    
+    ASTCCompressionSchedulerRelease(scheduler);
+    return texture;
+}
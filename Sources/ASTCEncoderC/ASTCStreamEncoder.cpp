@@ -0,0 +1,204 @@
+//
+//  ASTCStreamEncoder.cpp
+//  ASTCEncoder
+//
+//  Created by agent on 16.10.26.
+//
+
+#include "ASTCEncoderInternal.hpp"
+
+
+// Strips hold at least this many blocks per thread, narrow images get taller strips
+#define ASTC_STREAM_MIN_BLOCKS_PER_THREAD 256
+
+
+struct ASTCStripProgress {
+    void* __nullable userInfo;
+    ASTCEncoderProgressCallback __nullable callback;
+    long stripIndex;
+    long numStrips;
+};
+
+
+ASTCStreamEncoder::ASTCStreamEncoder(long width, long height, long numComponents, long componentSize, bool linear, bool hdr, long blockWidth, long blockHeight, const ASTCCompressionOptions& options, long numThreads, long numStripBlockRows):
+referenceCounter(1),
+_width(width),
+_height(height),
+_numComponents(numComponents),
+_componentSize(componentSize),
+_linear(linear),
+_hdr(hdr),
+_blockWidth(blockWidth),
+_blockHeight(blockHeight),
+_options(options),
+_numThreads(numThreads),
+_numStripBlockRows(numStripBlockRows) {
+    // Done
+}
+
+ASTCStreamEncoder::~ASTCStreamEncoder() {
+    // Done
+}
+
+
+ASTCStreamEncoder* __nullable ASTCStreamEncoderRetain(ASTCStreamEncoder* __nullable encoder) {
+    if (encoder) {
+        encoder->referenceCounter.fetch_add(1);
+    }
+    return encoder;
+}
+
+void ASTCStreamEncoderRelease(ASTCStreamEncoder* __nullable encoder) {
+    if (encoder && encoder->referenceCounter.fetch_sub(1) <= 1) {
+        delete encoder;
+    }
+}
+
+
+ASTCStreamEncoder* __nullable ASTCStreamEncoder::create(long width, long height, long numComponents, long componentSize, bool linear, bool hdr, long blockWidth, long blockHeight, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error) {
+    if (!validateImageFormat(width, height, numComponents, componentSize, hdr, error)) {
+        return nullptr;
+    }
+    
+    // Validate the configuration once, so encoding can't fail because of it later
+    astcenc_config config;
+    if (initCompressionConfig(getProfile(linear, hdr, numComponents), numComponents, 0, blockWidth, blockHeight, 1, options, &config) != astcenc_error::ASTCENC_SUCCESS) {
+        error.setErrorMessage("Could not initialise config");
+        return nullptr;
+    }
+    
+    auto numBlocksWidth = (width + blockWidth - 1) / blockWidth;
+    auto numBlocksHeight = (height + blockHeight - 1) / blockHeight;
+    long minNumStripBlocks = resolveNumThreads(numThreads, numBlocksWidth * numBlocksHeight) * ASTC_STREAM_MIN_BLOCKS_PER_THREAD;
+    auto numStripBlockRows = std::clamp((minNumStripBlocks + numBlocksWidth - 1) / numBlocksWidth, 1L, numBlocksHeight);
+    return new ASTCStreamEncoder(width, height, numComponents, componentSize, linear, hdr, blockWidth, blockHeight, options, numThreads, numStripBlockRows);
+}
+
+
+bool ASTCStreamEncoder::encode(ASTCRowReader __nonnull reader, ASTCBlockRowWriter __nonnull writer, void* __nullable streamUserInfo, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) {
+    auto numBlocksWidth = (_width + _blockWidth - 1) / _blockWidth;
+    auto numBlocksHeight = (_height + _blockHeight - 1) / _blockHeight;
+    auto numStrips = (numBlocksHeight + _numStripBlockRows - 1) / _numStripBlockRows;
+    auto stripHeight = _numStripBlockRows * _blockHeight;
+    auto bytesPerRow = _width * _numComponents * _componentSize;
+    auto expandedBytesPerRow = _width * 4 * _componentSize;
+    
+    astcenc_config config;
+    if (initCompressionConfig(getProfile(_linear, _hdr, _numComponents), _numComponents, 0, _blockWidth, _blockHeight, 1, _options, &config) != astcenc_error::ASTCENC_SUCCESS) {
+        error.setErrorMessage("Could not initialise config");
+        return false;
+    }
+    
+    // All strips share one context, which is reset between them
+    astcenc_context* context = nullptr;
+    auto contextNumThreads = resolveNumThreads(_numThreads, numBlocksWidth * _numStripBlockRows);
+    if (acquireContext(config, contextNumThreads, &context) != astcenc_error::ASTCENC_SUCCESS) {
+        error.setErrorMessage("Could not create context");
+        return false;
+    }
+    
+    // One strip is read while the other one is encoded. Rows with less than 4 components are read into their own buffer and expanded from there
+    std::vector<char> rows(_numComponents == 4 ? 0 : stripHeight * bytesPerRow);
+    std::vector<char> pixels[2] = {
+        std::vector<char>(stripHeight * expandedBytesPerRow),
+        std::vector<char>(stripHeight * expandedBytesPerRow)
+    };
+    std::vector<char> blocks[2] = {
+        std::vector<char>(numBlocksWidth * _numStripBlockRows * 16),
+        std::vector<char>(numBlocksWidth * _numStripBlockRows * 16)
+    };
+    
+    // Report progress of the whole image instead of individual strips
+    ASTCStripProgress stripProgress = {
+        .userInfo = userInfo,
+        .callback = progressCallback,
+        .stripIndex = 0,
+        .numStrips = numStrips
+    };
+    ASTCEncoderProgressCallback stripProgressCallback = [](void* __nullable userInfo, float progress) {
+        auto stripProgress = static_cast<ASTCStripProgress*>(userInfo);
+        auto totalProgress = (static_cast<float>(stripProgress->stripIndex) * 100.0f + progress) / static_cast<float>(stripProgress->numStrips);
+        return stripProgress->callback(stripProgress->userInfo, totalProgress);
+    };
+    
+    // Strips wrap the pixel buffers without taking them over
+    ASTCReleaseCallback keepPixels = [](void* __nullable, void* __nonnull) {
+        // Done
+    };
+    
+    std::thread encoder;
+    auto encoded = true;
+    ASTCErrorInfo encoderError;
+    
+    auto writeStrip = [&](long strip) {
+        auto blockY = strip * _numStripBlockRows;
+        auto numBlockRows = std::min(_numStripBlockRows, numBlocksHeight - blockY);
+        if (!writer(streamUserInfo, blocks[strip % 2].data(), numBlocksWidth * numBlockRows * 16, blockY, numBlockRows)) {
+            error.setErrorMessage("Could not write blocks");
+            return false;
+        }
+        
+        return true;
+    };
+    
+    auto success = true;
+    for (long strip = 0; strip < numStrips; strip++) {
+        auto y = strip * stripHeight;
+        auto numRows = std::min(stripHeight, _height - y);
+        auto stripPixels = pixels[strip % 2].data();
+        if (_numComponents == 4) {
+            success = reader(streamUserInfo, stripPixels, expandedBytesPerRow, y, numRows);
+        }
+        else if ((success = reader(streamUserInfo, rows.data(), bytesPerRow, y, numRows))) {
+            expandComponents(rows.data(), stripPixels, _width * numRows, _numComponents, _componentSize);
+        }
+        
+        if (!success) {
+            error.setErrorMessage("Could not read image rows");
+            break;
+        }
+        
+        // Wait for the previous strip, its blocks are written while this strip is encoded
+        if (encoder.joinable()) {
+            encoder.join();
+            astcenc_compress_reset(context);
+            if (!encoded) {
+                error = encoderError;
+                success = false;
+                break;
+            }
+        }
+        
+        stripProgress.stripIndex = strip;
+        encoder = std::thread([&, strip, numRows, stripPixels]() {
+            auto stripImage = new ASTCRawImage(stripPixels, _width, numRows, 1, _numComponents, _componentSize, _linear, _hdr, nullptr, keepPixels);
+            auto dataLength = stripImage->getCompressedDataSize(_blockWidth, _blockHeight, 1);
+            ASTCBlockStatistics statistics;
+            encoded = stripImage->compressWithContext(context, config, _options, contextNumThreads, _blockWidth, _blockHeight, 1, blocks[strip % 2].data(), dataLength, statistics, encoderError,
+                                                      &stripProgress, progressCallback ? stripProgressCallback : nullptr);
+            ASTCRawImageRelease(stripImage);
+        });
+        
+        if (strip > 0 && !writeStrip(strip - 1)) {
+            success = false;
+            break;
+        }
+    }
+    
+    if (encoder.joinable()) {
+        encoder.join();
+        if (success && !encoded) {
+            error = encoderError;
+            success = false;
+        }
+    }
+    
+    if (success) {
+        success = writeStrip(numStrips - 1);
+    }
+    
+    // Clean up
+    releaseContext(context);
+    
+    return success;
+}
@@ -0,0 +1,493 @@
+//
+//  ASTCTexture.cpp
+//  ASTCEncoder
+//
+//  Created by agent on 15.10.26.
+//
+
+#include "ASTCEncoderInternal.hpp"
+#include <stdio.h>
+#include <string.h>
+
+
+ASTCTexture::ASTCTexture(long numLevels, long numLayers, long numFaces):
+referenceCounter(1),
+_numLevels(numLevels),
+_numLayers(numLayers),
+_numFaces(numFaces),
+_images(numLevels * numLayers * numFaces, nullptr) {
+    // Done
+}
+
+ASTCTexture::~ASTCTexture() {
+    for (auto image: _images) {
+        ASTCImageRelease(image);
+    }
+}
+
+
+ASTCTexture* __nullable ASTCTextureRetain(ASTCTexture* __nullable texture) {
+    if (texture) {
+        texture->referenceCounter.fetch_add(1);
+    }
+    return texture;
+}
+
+void ASTCTextureRelease(ASTCTexture* __nullable texture) {
+    if (texture && texture->referenceCounter.fetch_sub(1) <= 1) {
+        delete texture;
+    }
+}
+
+
+ASTCTexture* __nullable ASTCTexture::create(long numLevels, long numLayers, long numFaces, ASTCErrorInfo& error) {
+    if (numLevels < 1 || numLayers < 1) {
+        error.setErrorMessage("Invalid number of levels or layers");
+        return nullptr;
+    }
+    
+    if (numFaces != 1 && numFaces != 6) {
+        error.setErrorMessage("Invalid number of faces");
+        return nullptr;
+    }
+    
+    return new ASTCTexture(numLevels, numLayers, numFaces);
+}
+
+
+bool ASTCTexture::setImage(long level, long layer, long face, ASTCImage* __nonnull image, ASTCErrorInfo& error) {
+    if (level < 0 || level >= _numLevels || layer < 0 || layer >= _numLayers || face < 0 || face >= _numFaces) {
+        error.setErrorMessage("Invalid image index");
+        return false;
+    }
+    
+    if (_numFaces == 6 && (image->_width != image->_height || image->_depth != 1)) {
+        error.setErrorMessage("Cube map faces must be square 2D images");
+        return false;
+    }
+    
+    auto& slot = _images[getImageIndex(level, layer, face)];
+    ASTCImageRetain(image);
+    ASTCImageRelease(slot);
+    slot = image;
+    return true;
+}
+
+
+ASTCImage* __nullable ASTCTexture::getImage(long level, long layer, long face) {
+    if (level < 0 || level >= _numLevels || layer < 0 || layer >= _numLayers || face < 0 || face >= _numFaces) {
+        return nullptr;
+    }
+    
+    return ASTCImageRetain(_images[getImageIndex(level, layer, face)]);
+}
+
+
+bool ASTCTexture::validate(ASTCErrorInfo& error) {
+    for (auto image: _images) {
+        if (image == nullptr) {
+            error.setErrorMessage("Texture is missing images");
+            return false;
+        }
+    }
+    
+    auto base = _images[0];
+    for (long level = 0; level < _numLevels; level++) {
+        auto width = std::max(1L, base->_width >> level);
+        auto height = std::max(1L, base->_height >> level);
+        auto depth = std::max(1L, base->_depth >> level);
+        for (long layer = 0; layer < _numLayers; layer++) {
+            for (long face = 0; face < _numFaces; face++) {
+                auto image = _images[getImageIndex(level, layer, face)];
+                if (_numFaces == 6 && (image->_width != image->_height || image->_depth != 1)) {
+                    error.setErrorMessage("Cube map faces must be square 2D images");
+                    return false;
+                }
+                
+                if (image->_blockWidth != base->_blockWidth || image->_blockHeight != base->_blockHeight || image->_blockDepth != base->_blockDepth) {
+                    error.setErrorMessage("Images have different block sizes");
+                    return false;
+                }
+                
+                if (image->_linear != base->_linear || image->_hdr != base->_hdr) {
+                    error.setErrorMessage("Images have different color formats");
+                    return false;
+                }
+                
+                if (image->_width != width || image->_height != height || image->_depth != depth) {
+                    error.setErrorMessage("Image size doesn't match its mip level");
+                    return false;
+                }
+            }
+        }
+    }
+    
+    return true;
+}
+
+
+// MARK: - KTX2 format
+
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_INDEX_ENTRY_SIZE 24
+#define KTX2_DFD_SIZE 44
+#define KTX2_MODEL_ASTC 162
+#define KTX2_PRIMARIES_BT709 1
+#define KTX2_TRANSFER_LINEAR 1
+#define KTX2_TRANSFER_SRGB 2
+#define KTX2_SAMPLE_SIGNED_FLOAT 0xC0
+
+static const uint8_t ktx2Identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+
+/// Block sizes in the order of Vulkan's ASTC formats.
+static const uint8_t ktx2BlockSizes[][2] = {
+    { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+    { 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 },
+};
+
+/// 3D block sizes in the order of `VK_EXT_texture_compression_astc_3d` formats.
+static const uint8_t ktx2BlockSizes3D[][3] = {
+    { 3, 3, 3 }, { 4, 3, 3 }, { 4, 4, 3 }, { 4, 4, 4 }, { 5, 4, 4 },
+    { 5, 5, 4 }, { 5, 5, 5 }, { 6, 5, 5 }, { 6, 6, 5 }, { 6, 6, 6 },
+};
+
+#define KTX2_NUM_BLOCK_SIZES static_cast<long>(sizeof(ktx2BlockSizes) / sizeof(ktx2BlockSizes[0]))
+#define KTX2_NUM_BLOCK_SIZES_3D static_cast<long>(sizeof(ktx2BlockSizes3D) / sizeof(ktx2BlockSizes3D[0]))
+#define VK_FORMAT_ASTC_4x4_UNORM_BLOCK 157
+#define VK_FORMAT_ASTC_4x4_SFLOAT_BLOCK 1000066000
+#define VK_FORMAT_ASTC_3x3x3_UNORM_BLOCK_EXT 1000288000
+
+
+/// Vulkan format of ASTC blocks with the given size and color format, `0` if there is none.
+static uint32_t getVkFormat(long blockWidth, long blockHeight, long blockDepth, bool linear, bool hdr) {
+    if (blockDepth != 1) {
+        // UNORM, SRGB and SFLOAT formats of each 3D block size follow each other
+        for (long i = 0; i < KTX2_NUM_BLOCK_SIZES_3D; i++) {
+            if (ktx2BlockSizes3D[i][0] == blockWidth && ktx2BlockSizes3D[i][1] == blockHeight && ktx2BlockSizes3D[i][2] == blockDepth) {
+                return static_cast<uint32_t>(VK_FORMAT_ASTC_3x3x3_UNORM_BLOCK_EXT + i * 3 + (hdr ? 2 : (linear ? 0 : 1)));
+            }
+        }
+        
+        return 0;
+    }
+    
+    for (long i = 0; i < KTX2_NUM_BLOCK_SIZES; i++) {
+        if (ktx2BlockSizes[i][0] == blockWidth && ktx2BlockSizes[i][1] == blockHeight) {
+            if (hdr) {
+                return static_cast<uint32_t>(VK_FORMAT_ASTC_4x4_SFLOAT_BLOCK + i);
+            }
+            
+            // UNORM and SRGB formats alternate
+            return static_cast<uint32_t>(VK_FORMAT_ASTC_4x4_UNORM_BLOCK + i * 2 + (linear ? 0 : 1));
+        }
+    }
+    
+    return 0;
+}
+
+
+static bool parseVkFormat(uint32_t vkFormat, long& blockWidth, long& blockHeight, long& blockDepth, bool& linear, bool& hdr) {
+    if (vkFormat >= VK_FORMAT_ASTC_3x3x3_UNORM_BLOCK_EXT && vkFormat < VK_FORMAT_ASTC_3x3x3_UNORM_BLOCK_EXT + KTX2_NUM_BLOCK_SIZES_3D * 3) {
+        auto index = (vkFormat - VK_FORMAT_ASTC_3x3x3_UNORM_BLOCK_EXT) / 3;
+        auto variant = (vkFormat - VK_FORMAT_ASTC_3x3x3_UNORM_BLOCK_EXT) % 3;
+        linear = variant != 1;
+        hdr = variant == 2;
+        blockWidth = ktx2BlockSizes3D[index][0];
+        blockHeight = ktx2BlockSizes3D[index][1];
+        blockDepth = ktx2BlockSizes3D[index][2];
+        return true;
+    }
+    
+    long index;
+    if (vkFormat >= VK_FORMAT_ASTC_4x4_SFLOAT_BLOCK && vkFormat < VK_FORMAT_ASTC_4x4_SFLOAT_BLOCK + KTX2_NUM_BLOCK_SIZES) {
+        index = vkFormat - VK_FORMAT_ASTC_4x4_SFLOAT_BLOCK;
+        linear = true;
+        hdr = true;
+    }
+    else if (vkFormat >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && vkFormat < VK_FORMAT_ASTC_4x4_UNORM_BLOCK + KTX2_NUM_BLOCK_SIZES * 2) {
+        index = (vkFormat - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2;
+        linear = (vkFormat - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) % 2 == 0;
+        hdr = false;
+    }
+    else {
+        return false;
+    }
+    
+    blockWidth = ktx2BlockSizes[index][0];
+    blockHeight = ktx2BlockSizes[index][1];
+    blockDepth = 1;
+    return true;
+}
+
+
+static void storeValue32(uint8_t* __nonnull bytes, uint32_t value) {
+    for (long i = 0; i < 4; i++) {
+        bytes[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+static void storeValue64(uint8_t* __nonnull bytes, uint64_t value) {
+    for (long i = 0; i < 8; i++) {
+        bytes[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+static uint32_t loadValue32(const uint8_t* __nonnull bytes) {
+    uint32_t value = 0;
+    for (long i = 0; i < 4; i++) {
+        value |= static_cast<uint32_t>(bytes[i]) << (i * 8);
+    }
+    return value;
+}
+
+static uint64_t loadValue64(const uint8_t* __nonnull bytes) {
+    uint64_t value = 0;
+    for (long i = 0; i < 8; i++) {
+        value |= static_cast<uint64_t>(bytes[i]) << (i * 8);
+    }
+    return value;
+}
+
+
+/// Data format descriptor with a single basic block describing ASTC data.
+static void makeDataFormatDescriptor(long blockWidth, long blockHeight, long blockDepth, bool linear, bool hdr, uint8_t* __nonnull dfd) {
+    memset(dfd, 0, KTX2_DFD_SIZE);
+    storeValue32(dfd, KTX2_DFD_SIZE);
+    
+    // Basic descriptor block header: vendor and type 0, version 2, size of the block with one sample
+    auto block = dfd + 4;
+    storeValue32(block + 0, 0);
+    storeValue32(block + 4, 2 | ((KTX2_DFD_SIZE - 4) << 16));
+    // HDR data is always linear, there is no sRGB variant of HDR formats
+    auto transfer = linear || hdr ? KTX2_TRANSFER_LINEAR : KTX2_TRANSFER_SRGB;
+    storeValue32(block + 8, KTX2_MODEL_ASTC | (KTX2_PRIMARIES_BT709 << 8) | (transfer << 16));
+    storeValue32(block + 12, static_cast<uint32_t>((blockWidth - 1) | ((blockHeight - 1) << 8) | ((blockDepth - 1) << 16)));
+    storeValue32(block + 16, 16);
+    
+    // The only sample covers all 128 bits of the block
+    auto sample = block + 24;
+    uint32_t qualifiers = hdr ? KTX2_SAMPLE_SIGNED_FLOAT : 0;
+    storeValue32(sample + 0, (127 << 16) | (qualifiers << 24));
+    if (hdr) {
+        float lower = -1.0f;
+        float upper = 1.0f;
+        memcpy(sample + 8, &lower, 4);
+        memcpy(sample + 12, &upper, 4);
+    }
+    else {
+        storeValue32(sample + 8, 0);
+        storeValue32(sample + 12, UINT32_MAX);
+    }
+}
+
+
+/// Level data is aligned to the block size, which is also a multiple of 4.
+static uint64_t alignLevelOffset(uint64_t offset) {
+    return (offset + 15) & ~static_cast<uint64_t>(15);
+}
+
+
+// MARK: - Writing
+
+bool ASTCTexture::write(const char* __nonnull path, ASTCErrorInfo& error) {
+    if (!validate(error)) {
+        return false;
+    }
+    
+    auto base = _images[0];
+    auto vkFormat = getVkFormat(base->_blockWidth, base->_blockHeight, base->_blockDepth, base->_linear, base->_hdr);
+    if (vkFormat == 0) {
+        error.setErrorMessage("Block size is not supported by KTX2");
+        return false;
+    }
+    
+    // Lay out the file up front, so it can be written front to back. Levels are stored from the smallest to the largest one
+    auto levelIndexSize = _numLevels * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+    auto dfdOffset = KTX2_HEADER_SIZE + levelIndexSize;
+    std::vector<uint64_t> levelOffsets(_numLevels);
+    std::vector<uint64_t> levelSizes(_numLevels);
+    uint64_t offset = dfdOffset + KTX2_DFD_SIZE;
+    for (auto level = _numLevels - 1; level >= 0; level--) {
+        offset = alignLevelOffset(offset);
+        levelOffsets[level] = offset;
+        levelSizes[level] = 0;
+        for (long layer = 0; layer < _numLayers; layer++) {
+            for (long face = 0; face < _numFaces; face++) {
+                levelSizes[level] += _images[getImageIndex(level, layer, face)]->getDataSize();
+            }
+        }
+        offset += levelSizes[level];
+    }
+    
+    std::vector<uint8_t> header(dfdOffset + KTX2_DFD_SIZE, 0);
+    memcpy(header.data(), ktx2Identifier, sizeof(ktx2Identifier));
+    storeValue32(header.data() + 12, vkFormat);
+    storeValue32(header.data() + 16, 1);
+    storeValue32(header.data() + 20, static_cast<uint32_t>(base->_width));
+    storeValue32(header.data() + 24, static_cast<uint32_t>(base->_height));
+    storeValue32(header.data() + 28, base->_depth > 1 ? static_cast<uint32_t>(base->_depth) : 0);
+    storeValue32(header.data() + 32, _numLayers > 1 ? static_cast<uint32_t>(_numLayers) : 0);
+    storeValue32(header.data() + 36, static_cast<uint32_t>(_numFaces));
+    storeValue32(header.data() + 40, static_cast<uint32_t>(_numLevels));
+    storeValue32(header.data() + 44, 0);
+    storeValue32(header.data() + 48, static_cast<uint32_t>(dfdOffset));
+    storeValue32(header.data() + 52, KTX2_DFD_SIZE);
+    for (long level = 0; level < _numLevels; level++) {
+        auto entry = header.data() + KTX2_HEADER_SIZE + level * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+        storeValue64(entry + 0, levelOffsets[level]);
+        storeValue64(entry + 8, levelSizes[level]);
+        storeValue64(entry + 16, levelSizes[level]);
+    }
+    makeDataFormatDescriptor(base->_blockWidth, base->_blockHeight, base->_blockDepth, base->_linear, base->_hdr, header.data() + dfdOffset);
+    
+    auto file = fopen(path, "wb");
+    if (file == nullptr) {
+        error.setErrorMessage("Could not create file");
+        return false;
+    }
+    
+    // Blocks are written straight from the images
+    static const uint8_t padding[16] = {};
+    uint64_t position = header.size();
+    auto success = fwrite(header.data(), 1, header.size(), file) == header.size();
+    for (auto level = _numLevels - 1; level >= 0 && success; level--) {
+        auto paddingSize = levelOffsets[level] - position;
+        success = fwrite(padding, 1, paddingSize, file) == paddingSize;
+        for (long layer = 0; layer < _numLayers && success; layer++) {
+            for (long face = 0; face < _numFaces && success; face++) {
+                auto image = _images[getImageIndex(level, layer, face)];
+                auto dataLength = static_cast<size_t>(image->getDataSize());
+                success = fwrite(image->_data, 1, dataLength, file) == dataLength;
+            }
+        }
+        position = levelOffsets[level] + levelSizes[level];
+    }
+    success = fclose(file) == 0 && success;
+    if (!success) {
+        error.setErrorMessage("Could not write file");
+        remove(path);
+        return false;
+    }
+    
+    return true;
+}
+
+
+// MARK: - Reading
+
+ASTCTexture* __nullable ASTCTexture::load(const char* __nonnull path, long numComponents, long componentSize, ASTCErrorInfo& error) {
+    if (numComponents < 1 || numComponents > 4) {
+        error.setErrorMessage("Unsupported number of components");
+        return nullptr;
+    }
+    
+    if (componentSize != 1 && componentSize != 2 && componentSize != 4) {
+        error.setErrorMessage("Unsupported component size");
+        return nullptr;
+    }
+    
+    auto mapping = mapFile(path, error);
+    if (mapping == nullptr) {
+        return nullptr;
+    }
+    
+    ASTCTexture* texture = nullptr;
+    auto fail = [&](const char* __nonnull errorMessage) -> ASTCTexture* {
+        error.setErrorMessage(errorMessage);
+        ASTCTextureRelease(texture);
+        releaseFileMapping(mapping, mapping->data);
+        return nullptr;
+    };
+    
+    auto bytes = reinterpret_cast<const uint8_t*>(mapping->data);
+    if (mapping->size < KTX2_HEADER_SIZE || memcmp(bytes, ktx2Identifier, sizeof(ktx2Identifier)) != 0) {
+        return fail("Invalid KTX2 file");
+    }
+    
+    long blockWidth, blockHeight, blockDepth;
+    bool linear, hdr;
+    if (!parseVkFormat(loadValue32(bytes + 12), blockWidth, blockHeight, blockDepth, linear, hdr)) {
+        return fail("KTX2 file doesn't contain ASTC data");
+    }
+    
+    if (loadValue32(bytes + 44) != 0) {
+        return fail("Supercompressed KTX2 files are not supported");
+    }
+    
+    // Zero counts mean "not an array" and "no mip levels" in KTX2
+    long width = loadValue32(bytes + 20);
+    long height = std::max(1u, loadValue32(bytes + 24));
+    long depth = std::max(1u, loadValue32(bytes + 28));
+    long numLayers = std::max(1u, loadValue32(bytes + 32));
+    long numFaces = loadValue32(bytes + 36);
+    long numLevels = std::max(1u, loadValue32(bytes + 40));
+    if (width == 0 || (numFaces != 1 && numFaces != 6) || (numFaces == 6 && (width != height || depth != 1)) || numLevels > 32) {
+        return fail("Invalid KTX2 file");
+    }
+    
+    if (mapping->size < static_cast<size_t>(KTX2_HEADER_SIZE + numLevels * KTX2_LEVEL_INDEX_ENTRY_SIZE)) {
+        return fail("File is truncated");
+    }
+    
+    // Every image takes at least one block, which bounds the number of images before any of them are allocated
+    uint64_t numLevelImages;
+    if (__builtin_mul_overflow(static_cast<uint64_t>(numLayers), static_cast<uint64_t>(numFaces), &numLevelImages) ||
+        numLevelImages * numLevels > mapping->size / 16) {
+        return fail("File is truncated");
+    }
+    
+    // Check all levels before creating the texture. The sizes come from the file, so their products are checked for overflow
+    struct ASTCLevelLayout {
+        long width;
+        long height;
+        long depth;
+        long numBlocksWidth;
+        long numBlocksHeight;
+        long numBlocksDepth;
+        uint64_t offset;
+        uint64_t imageSize;
+    };
+    std::vector<ASTCLevelLayout> levels(numLevels);
+    for (long level = 0; level < numLevels; level++) {
+        auto entry = bytes + KTX2_HEADER_SIZE + level * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+        auto levelOffset = loadValue64(entry + 0);
+        auto levelSize = loadValue64(entry + 8);
+        
+        auto& layout = levels[level];
+        layout.width = std::max(1L, width >> level);
+        layout.height = std::max(1L, height >> level);
+        layout.depth = std::max(1L, depth >> level);
+        layout.numBlocksWidth = (layout.width + blockWidth - 1) / blockWidth;
+        layout.numBlocksHeight = (layout.height + blockHeight - 1) / blockHeight;
+        layout.numBlocksDepth = (layout.depth + blockDepth - 1) / blockDepth;
+        layout.offset = levelOffset;
+        
+        uint64_t levelImagesSize;
+        if (__builtin_mul_overflow(static_cast<uint64_t>(layout.numBlocksWidth), static_cast<uint64_t>(layout.numBlocksHeight), &layout.imageSize) ||
+            __builtin_mul_overflow(layout.imageSize, static_cast<uint64_t>(layout.numBlocksDepth) * 16, &layout.imageSize) ||
+            __builtin_mul_overflow(layout.imageSize, numLevelImages, &levelImagesSize) ||
+            levelSize < levelImagesSize || levelOffset > mapping->size || mapping->size - levelOffset < levelSize) {
+            return fail("File is truncated");
+        }
+    }
+    
+    texture = new ASTCTexture(numLevels, numLayers, numFaces);
+    for (long level = 0; level < numLevels; level++) {
+        // Every image holds its own reference to the mapping
+        auto& layout = levels[level];
+        for (long layer = 0; layer < numLayers; layer++) {
+            for (long face = 0; face < numFaces; face++) {
+                auto imageData = mapping->data + layout.offset + (layer * numFaces + face) * layout.imageSize;
+                retainFileMapping(mapping);
+                texture->_images[texture->getImageIndex(level, layer, face)] = new ASTCImage(imageData, layout.width, layout.height, layout.depth, numComponents, componentSize, linear, hdr,
+                                                                                             layout.numBlocksWidth, layout.numBlocksHeight, layout.numBlocksDepth, blockWidth, blockHeight, blockDepth,
+                                                                                             mapping, releaseFileMapping);
+            }
+        }
+    }
+    
+    // Images keep the mapping alive from now on
+    releaseFileMapping(mapping, mapping->data);
+    return texture;
+}
@@ -0,0 +1,90 @@
+//
+//  ASTCBatchEncoder.hpp
+//  ASTCEncoder
+//
+//  Created by agent on 15.10.26.
+//
+
+#ifndef ASTCBatchEncoder_hpp
+#define ASTCBatchEncoder_hpp
+
+#if defined __cplusplus
+
+#include <ASTCEncoderC.hpp>
+
+
+/// Compresses many images with the same block size and encoder settings.
+///
+/// All images of a batch share one encoder context, which is reset between images instead of being allocated again. This makes large sets of small images, such as icons and sprites, much cheaper to compress.
+class ASTCBatchEncoder {
+private:
+    std::atomic<size_t> referenceCounter;
+    
+    const long _blockWidth;
+    const long _blockHeight;
+    const ASTCCompressionOptions _options;
+    const long _numThreads;
+    
+    std::vector<ASTCRawImage*> _images;
+    std::vector<ASTCImage*> _compressedImages;
+    
+    double _encodingTime;
+    long _numPixels;
+    long _numBlocks;
+    
+    
+    friend ASTCBatchEncoder* __nullable ASTCBatchEncoderRetain(ASTCBatchEncoder* __nullable encoder) SWIFT_RETURNS_UNRETAINED;
+    friend void ASTCBatchEncoderRelease(ASTCBatchEncoder* __nullable encoder);
+    
+    
+    ASTCBatchEncoder(long blockWidth, long blockHeight, const ASTCCompressionOptions& options, long numThreads);
+    ~ASTCBatchEncoder();
+    
+    void removeCompressedImages();
+    
+public:
+    /// Creates a batch encoder.
+    ///
+    /// Pass `0` or a negative value as `numThreads` to use all available cores.
+    static ASTCBatchEncoder* __nullable create(long blockWidth, long blockHeight, float quality, long numThreads, ASTCErrorInfo& error) SWIFT_NAME(__createUnsafe(blockWidth:blockHeight:quality:numThreads:error:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Creates a batch encoder that compresses with the given encoder settings.
+    static ASTCBatchEncoder* __nullable create(long blockWidth, long blockHeight, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error) SWIFT_NAME(__createUnsafe(blockWidth:blockHeight:options:numThreads:error:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Adds an image to the batch.
+    void addImage(ASTCRawImage* __nonnull image);
+    
+    /// Removes all images and compression results from the batch.
+    void removeAllImages();
+    
+    long getNumberOfImages() SWIFT_COMPUTED_PROPERTY { return static_cast<long>(_images.size()); }
+    
+    /// Compresses all images of the batch.
+    ///
+    /// Progress is reported for the whole batch.
+    bool encode(ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__encodeUnsafe(error:userInfo:progressCallback:));
+    
+    /// Compressed image at `index`, available after a successful ``encode``.
+    ASTCImage* __nullable getCompressedImage(long index) SWIFT_NAME(__getCompressedImageUnsafe(_:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Duration of the last ``encode`` call in seconds.
+    double getEncodingTime() SWIFT_COMPUTED_PROPERTY { return _encodingTime; }
+    
+    /// Number of pixels compressed by the last ``encode`` call.
+    long getNumberOfPixels() SWIFT_COMPUTED_PROPERTY { return _numPixels; }
+    
+    /// Number of ASTC blocks produced by the last ``encode`` call.
+    long getNumberOfBlocks() SWIFT_COMPUTED_PROPERTY { return _numBlocks; }
+    
+    /// Throughput of the last ``encode`` call in megapixels per second.
+    double getMegapixelsPerSecond() SWIFT_COMPUTED_PROPERTY {
+        return _encodingTime > 0 ? static_cast<double>(_numPixels) / _encodingTime / 1000000.0 : 0;
+    }
+}
+SWIFT_SHARED_REFERENCE(ASTCBatchEncoderRetain, ASTCBatchEncoderRelease)
+SWIFT_UNCHECKED_SENDABLE;
+
+
+#endif // __cplusplus
+
+#endif // ASTCBatchEncoder_hpp
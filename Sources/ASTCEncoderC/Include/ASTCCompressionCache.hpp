@@ -0,0 +1,78 @@
+//
+//  ASTCCompressionCache.hpp
+//  ASTCEncoder
+//
+//  Created by agent on 16.10.26.
+//
+
+#ifndef ASTCCompressionCache_hpp
+#define ASTCCompressionCache_hpp
+
+#if defined __cplusplus
+
+#include <ASTCEncoderC.hpp>
+#include <string>
+
+
+struct ASTCCacheKey;
+
+
+/// Keeps compressed images in a directory, so unchanged images don't go through the encoder again.
+///
+/// Entries are found by a 64 bit XXH64 hash of the pixels together with the complete encoder configuration, so any change of the image, block size or encoder settings is a miss. Every entry stores its whole key, so entries whose file names collide are never mixed up.
+///
+/// Entries are written to a temporary file that is renamed into place, so other processes sharing the directory never see half-written entries. Hits are mapped into memory copy-on-write and used without copying the blocks.
+class ASTCCompressionCache {
+private:
+    std::atomic<size_t> referenceCounter;
+    
+    const std::string _directory;
+    const long _maxSize;
+    
+    std::atomic<long> _numHits;
+    std::atomic<long> _numMisses;
+    
+    
+    friend ASTCCompressionCache* __nullable ASTCCompressionCacheRetain(ASTCCompressionCache* __nullable cache) SWIFT_RETURNS_UNRETAINED;
+    friend void ASTCCompressionCacheRelease(ASTCCompressionCache* __nullable cache);
+    
+    
+    ASTCCompressionCache(const char* __nonnull directory, long maxSize);
+    ~ASTCCompressionCache();
+    
+    /// Maps the entry at `path` if it was stored for `key`, otherwise returns `nullptr`.
+    ASTCImage* __nullable loadEntry(const std::string& path, const ASTCCacheKey& key, ASTCRawImage* __nonnull image, long blockWidth, long blockHeight, long blockDepth);
+    
+    /// Compresses `image` into a new entry at `path` and returns the compressed image mapped from it.
+    ASTCImage* __nullable storeEntry(const std::string& path, const ASTCCacheKey& key, ASTCRawImage* __nonnull image, long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback);
+    
+    /// Removes least recently used entries until all entries fit into ``getMaxSize``.
+    void evictEntries();
+    
+public:
+    /// Creates a cache in `directory`. The directory is created if it doesn't exist yet.
+    ///
+    /// Least recently used entries are removed once all entries take more than `maxSize` bytes. Pass `0` or a negative value as `maxSize` to never remove entries.
+    static ASTCCompressionCache* __nullable create(const char* __nonnull directory, long maxSize, ASTCErrorInfo& error) SWIFT_NAME(__createUnsafe(_:maxSize:error:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Returns the cached compressed image or compresses `image` and stores the result.
+    ///
+    /// Hits don't run the encoder at all, the returned image uses the blocks of the mapped entry. Misses are compressed directly into the new entry. If the entry can't be written, the image is compressed without the cache.
+    ASTCImage* __nullable compress(ASTCRawImage* __nonnull image, long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressUnsafe(_:blockWidth:blockHeight:blockDepth:options:numThreads:error:userInfo:progressCallback:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Size limit of all entries in bytes, `0` if entries are never removed.
+    long getMaxSize() SWIFT_COMPUTED_PROPERTY { return _maxSize; }
+    
+    /// Number of images that were found in the cache.
+    long getNumberOfHits() SWIFT_COMPUTED_PROPERTY { return _numHits.load(); }
+    
+    /// Number of images that had to be compressed.
+    long getNumberOfMisses() SWIFT_COMPUTED_PROPERTY { return _numMisses.load(); }
+}
+SWIFT_SHARED_REFERENCE(ASTCCompressionCacheRetain, ASTCCompressionCacheRelease)
+SWIFT_UNCHECKED_SENDABLE;
+
+
+#endif // __cplusplus
+
+#endif // ASTCCompressionCache_hpp
@@ -0,0 +1,97 @@
+//
+//  ASTCCompressionScheduler.hpp
+//  ASTCEncoder
+//
+//  Created by agent on 15.10.26.
+//
+
+#ifndef ASTCCompressionScheduler_hpp
+#define ASTCCompressionScheduler_hpp
+
+#if defined __cplusplus
+
+#include <ASTCEncoderC.hpp>
+
+
+#define ASTC_SCHEDULER_DEFAULT_LARGE_IMAGE_THRESHOLD 8192
+
+
+/// Compresses a set of images of mixed sizes on a fixed number of threads.
+///
+/// Splitting the blocks of a small image across threads barely pays off, while compressing many small images side by side scales well. The scheduler therefore compresses every small image on a single worker. Large images are split into slices of block rows, which are queued next to the small images. Workers that run out of work steal it from the others, so small images fill the cores that a large image leaves idle and the other way round.
+///
+/// Slices are encoded on their own, which matches compressing the whole image. Large images using alpha scaling with a radius look across block rows and are never split, they're compressed one after another on all threads before the workers start. All work runs on one set of workers that never exceeds the requested number of threads, so the scheduler doesn't oversubscribe the cores.
+class ASTCCompressionScheduler {
+private:
+    struct Job {
+        ASTCRawImage* __nonnull image;
+        long blockWidth;
+        long blockHeight;
+        ASTCCompressionOptions options;
+        long numBlocks;
+    };
+    
+    std::atomic<size_t> referenceCounter;
+    
+    const long _numThreads;
+    long _largeImageThreshold;
+    
+    std::vector<Job> _jobs;
+    std::vector<ASTCImage*> _compressedImages;
+    
+    double _encodingTime;
+    long _numStolenJobs;
+    
+    
+    friend ASTCCompressionScheduler* __nullable ASTCCompressionSchedulerRetain(ASTCCompressionScheduler* __nullable scheduler) SWIFT_RETURNS_UNRETAINED;
+    friend void ASTCCompressionSchedulerRelease(ASTCCompressionScheduler* __nullable scheduler);
+    
+    
+    ASTCCompressionScheduler(long numThreads);
+    ~ASTCCompressionScheduler();
+    
+    void removeCompressedImages();
+    
+public:
+    /// Creates a scheduler that runs on `numThreads` threads.
+    ///
+    /// Pass `0` or a negative value as `numThreads` to use all available cores.
+    static ASTCCompressionScheduler* __nonnull create(long numThreads) SWIFT_NAME(__createUnsafe(numThreads:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Minimum number of blocks of an image to be split into slices instead of being compressed on a single worker.
+    long getLargeImageThreshold() SWIFT_COMPUTED_PROPERTY { return _largeImageThreshold; }
+    
+    void setLargeImageThreshold(long numBlocks) SWIFT_COMPUTED_PROPERTY { _largeImageThreshold = numBlocks; }
+    
+    /// Adds an image to compress with the given block size and quality.
+    bool addImage(ASTCRawImage* __nonnull image, long blockWidth, long blockHeight, float quality, ASTCErrorInfo& error) SWIFT_NAME(__addImageUnsafe(_:blockWidth:blockHeight:quality:error:));
+    
+    /// Adds an image to compress with the given block size and encoder settings.
+    bool addImage(ASTCRawImage* __nonnull image, long blockWidth, long blockHeight, const ASTCCompressionOptions& options, ASTCErrorInfo& error) SWIFT_NAME(__addImageUnsafe(_:blockWidth:blockHeight:options:error:));
+    
+    /// Removes all images and compression results from the scheduler.
+    void removeAllImages();
+    
+    long getNumberOfImages() SWIFT_COMPUTED_PROPERTY { return static_cast<long>(_jobs.size()); }
+    
+    /// Compresses all images.
+    ///
+    /// Progress is reported for the whole set of images while they're encoded, from any of the worker threads. Cancelling stops the images and slices being encoded right away.
+    bool run(ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__runUnsafe(error:userInfo:progressCallback:));
+    
+    /// Compressed image at `index` in the order the images were added, available after a successful ``run``.
+    ASTCImage* __nullable getCompressedImage(long index) SWIFT_NAME(__getCompressedImageUnsafe(_:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Duration of the last ``run`` call in seconds.
+    double getEncodingTime() SWIFT_COMPUTED_PROPERTY { return _encodingTime; }
+    
+    /// Number of images and slices that workers took from other workers during the last ``run`` call.
+    long getNumberOfStolenJobs() SWIFT_COMPUTED_PROPERTY { return _numStolenJobs; }
+}
+SWIFT_SHARED_REFERENCE(ASTCCompressionSchedulerRetain, ASTCCompressionSchedulerRelease)
+SWIFT_UNCHECKED_SENDABLE;
+
+
+#endif // __cplusplus
+
+#endif // ASTCCompressionScheduler_hpp
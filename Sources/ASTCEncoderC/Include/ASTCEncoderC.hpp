@@ -13,13 +13,23 @@
 #include <swift/bridging>
 #include <atomic>
 #include <string_view>
+#include <vector>
+#include <functional>
 
 
 #define ASTC_ENCODER_ERROR_SIZE 128
 
 
+struct astcenc_context;
+struct astcenc_config;
+
 class ASTCRawImage;
 class ASTCImage;
+class ASTCBatchEncoder;
+class ASTCCompressionScheduler;
+class ASTCTexture;
+class ASTCCompressionCache;
+class ASTCStreamEncoder;
 
 
 struct ASTCErrorInfo final {
@@ -42,10 +52,190 @@ public:
 
 typedef bool (* ASTCEncoderProgressCallback)(void* __nullable userInfo, float progress);
 
+/// Releases image memory owned by the caller once the image doesn't need it anymore.
+typedef void (* ASTCReleaseCallback)(void* __nullable userInfo, void* __nonnull data);
+
+/// Pool of ASTC encoder contexts shared by all compression and decompression calls.
+///
+/// Allocating a context builds the partition and block mode tables, which for small images takes longer than the encoding itself. Idle contexts are kept in the pool and handed out again to calls with the same profile, block size, encoder settings and thread count.
+class ASTCContextPool final {
+public:
+    ASTCContextPool() = delete;
+    
+    /// Maximum number of idle contexts kept in the pool. The least recently used ones are freed first.
+    static long getCapacity();
+    
+    /// Sets the maximum number of idle contexts kept in the pool. Pass `0` to disable context reuse.
+    static void setCapacity(long capacity);
+    
+    /// Number of idle contexts currently kept in the pool.
+    static long getNumberOfIdleContexts();
+    
+    /// Frees all idle contexts.
+    static void purge();
+};
+
+
+/// Filter used to compute mipmap levels.
+enum class ASTCMipmapFilter: long {
+    /// Average of 2x2 pixels. Fast, but slightly blurry.
+    box,
+    
+    /// Kaiser windowed sinc. Keeps lower levels sharper at a higher cost.
+    kaiser
+};
+
+
+/// Encoder effort of a compression preset.
+enum class ASTCSpeedPreset: long {
+    /// Lowest effort, for previews and iteration.
+    fastest,
+    
+    /// Low effort, usually a fraction of a decibel below `medium` at several times its speed.
+    fast,
+    
+    /// Balanced effort.
+    medium,
+    
+    /// High effort, for final builds.
+    thorough,
+    
+    /// Searches all encodings. Very slow.
+    exhaustive
+};
+
+
+/// Kind of content a compression preset is tuned for.
+enum class ASTCContentClass: long {
+    /// Photographs, albedo and other colour textures.
+    color,
+    
+    /// Normal maps, created with ``ASTCRawImage/createNormalMap``.
+    normalMap,
+    
+    /// Roughness, occlusion and other masks, mostly flat areas with soft transitions.
+    mask,
+    
+    /// Interface elements and text with sharp edges and transparent areas.
+    ui
+};
+
+
+/// Settings of the encoder.
+///
+/// Tuning values of `0` are derived by astcenc from `quality` and the block size, set them to override single search limits.
+struct ASTCCompressionOptions {
+    /// Encoder effort between `0` (fastest) and `100` (exhaustive).
+    float quality = 60;
+    
+    /// Error weight of the red component. Weights of components the image doesn't have are ignored.
+    float redWeight = 1;
+    
+    /// Error weight of the green component.
+    float greenWeight = 1;
+    
+    /// Error weight of the blue component.
+    float blueWeight = 1;
+    
+    /// Error weight of the alpha component.
+    float alphaWeight = 1;
+    
+    /// Weighs colour errors by alpha, so nearly transparent texels get less precision.
+    bool alphaWeighted = false;
+    
+    /// Radius in texels over which alpha is averaged for ``alphaWeighted``. `0` uses the texel's own alpha.
+    long alphaScaleRadius = 0;
+    
+    /// Optimises for perceived instead of numeric error. astcenc only uses it for normal maps.
+    bool perceptual = false;
+    
+    /// Maximum number of partitions searched, between `1` and `4`.
+    long partitionCountLimit = 0;
+    
+    /// Number of partitionings searched for blocks with 2 partitions.
+    long twoPartitionIndexLimit = 0;
+    
+    /// Number of partitionings searched for blocks with 3 partitions.
+    long threePartitionIndexLimit = 0;
+    
+    /// Number of partitionings searched for blocks with 4 partitions.
+    long fourPartitionIndexLimit = 0;
+    
+    /// Percentile of the most common block modes searched, between `1` and `100`.
+    long blockModeLimit = 0;
+    
+    /// Maximum number of refinement iterations of the colour endpoints and weights.
+    long refinementLimit = 0;
+    
+    /// Number of trial candidates refined per block mode.
+    long candidateLimit = 0;
+    
+    /// Number of 2 partition candidates refined.
+    long twoPartitioningCandidateLimit = 0;
+    
+    /// Number of 3 partition candidates refined.
+    long threePartitioningCandidateLimit = 0;
+    
+    /// Number of 4 partition candidates refined.
+    long fourPartitioningCandidateLimit = 0;
+    
+    /// Peak signal to noise ratio in decibels at which the search of a block stops.
+    float dbLimit = 0;
+    
+    /// Factor by which the error of a block may exceed the target before further modes are searched.
+    float mseOvershoot = 0;
+    
+    /// Factor of the single partition error under which 2 partitions aren't searched.
+    float twoPartitionEarlyOutLimitFactor = 0;
+    
+    /// Factor of the 2 partition error under which 3 partitions aren't searched.
+    float threePartitionEarlyOutLimitFactor = 0;
+    
+    /// Correlation of components above which dual plane encodings aren't searched.
+    float twoPlaneEarlyOutLimitCorrelation = 0;
+    
+    /// Encodes blocks whose texels repeat an earlier block of the image only once, the copies reuse that encoding.
+    ///
+    /// Pays off for tiled art, atlases with repeated glyphs and padding. Every block is hashed, so images without repeats get a little slower.
+    bool deduplicateBlocks = false;
+    
+    /// Writes blocks of a single colour of LDR images directly as constant colour blocks instead of passing them to the encoder.
+    ///
+    /// Every block is compared texel by texel first. Turn it off for content that rarely has flat areas.
+    bool detectConstantBlocks = true;
+    
+    
+    /// Options of a named preset for the given kind of content.
+    ///
+    /// Faster presets skip searches that rarely pay off for the content class, which for large jobs is worth a small loss of PSNR.
+    static ASTCCompressionOptions preset(ASTCSpeedPreset speed, ASTCContentClass contentClass) SWIFT_NAME(preset(_:contentClass:));
+};
+
+
+/// Blocks of a compressed image that didn't need a search of the encoder.
+struct ASTCBlockStatistics {
+    /// Blocks of a single colour, written as constant colour blocks.
+    long numConstantBlocks = 0;
+    
+    /// Blocks with the same texels as another block of the image, which reuse its encoding. Only counted with ``ASTCCompressionOptions/deduplicateBlocks``.
+    long numDuplicateBlocks = 0;
+};
+
+
+/// Rectangle of pixels of an image.
+struct ASTCRect {
+    long x;
+    long y;
+    long width;
+    long height;
+};
+
 
 /// Uncompressed image that is ready for ASTC compression.
 ///
-/// At the moment it's a 2D image.
+/// Either a 2D image or a 3D volume, whose `depth` slices are stored one after another.
+///
+/// The number of components the image was created with decides how it's encoded: 1 component is greyscale, 2 components are greyscale and alpha, 3 components are RGB and 4 components are RGBA.
 class ASTCRawImage {
 private:
     std::atomic<size_t> referenceCounter;
@@ -53,36 +243,152 @@ private:
     /*const*/ char* __nonnull _data;
     const long _width;
     const long _height;
+    const long _depth;
     const long _originalNumComponents;
     const long _componentSize;
     const bool _linear;
     const bool _hdr;
+    // Set for images created with createNormalMap, their blocks only store X and Y
+    bool _normalMap;
+    
+    // Releases caller-owned data. The data was allocated with `new []` if not set
+    void* __nullable _releaseUserInfo;
+    ASTCReleaseCallback __nullable _releaseCallback;
     
     
     friend ASTCRawImage* __nullable ASTCRawImageRetain(ASTCRawImage* __nullable image) SWIFT_RETURNS_UNRETAINED;
     friend void ASTCRawImageRelease(ASTCRawImage* __nullable image);
     
     friend class ASTCImage;
+    friend class ASTCBatchEncoder;
+    friend class ASTCCompressionScheduler;
+    friend class ASTCCompressionCache;
+    friend class ASTCStreamEncoder;
     
     
-    ASTCRawImage(char* __nonnull data, long width, long height, long originalNumComponents, long componentSize, bool linear, bool hdr);
+    ASTCRawImage(char* __nonnull data, long width, long height, long depth, long originalNumComponents, long componentSize, bool linear, bool hdr, void* __nullable releaseUserInfo = nullptr, ASTCReleaseCallback __nullable releaseCallback = nullptr);
     ~ASTCRawImage();
     
+    /// Initialises `config` for compressing this image, following its colour space and the components it has.
+    bool makeCompressionConfig(long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, astcenc_config* __nonnull config);
+    
+    /// Compresses the image with an already allocated context that was created with `config`. The context is not reset afterwards.
+    ///
+    /// Depending on `options`, blocks of a single colour are written directly and repeated blocks are encoded once. The encoder only searches the others.
+    ASTCImage* __nullable compressWithContext(astcenc_context* __nonnull context, const astcenc_config& config, const ASTCCompressionOptions& options, unsigned int numThreads, long blockWidth, long blockHeight, long blockDepth, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback);
+    
+    /// Compresses the image into `buffer` with an already allocated context. `dataLength` must be ``getCompressedDataSize(_:_:_:)`` bytes.
+    bool compressWithContext(astcenc_context* __nonnull context, const astcenc_config& config, const ASTCCompressionOptions& options, unsigned int numThreads, long blockWidth, long blockHeight, long blockDepth, char* __nonnull buffer, long dataLength, ASTCBlockStatistics& statistics, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback);
+    
+    /// Compresses the image into `buffer` and reports the blocks the encoder could skip in `statistics`.
+    bool compressInto(char* __nonnull buffer, long capacity, long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, long numThreads, ASTCBlockStatistics& statistics, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback);
+    
+    /// Compresses only the 2D blocks listed in `blockIndices` into `buffer`, which holds the blocks of the whole image. Other blocks of `buffer` are left as they are.
+    bool compressBlocksInto(char* __nonnull buffer, long blockWidth, long blockHeight, const ASTCCompressionOptions& options, long numThreads, std::vector<uint32_t>& blockIndices, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback);
+    
+    /// Wraps compressed blocks of this image, takes over `astcData`.
+    ASTCImage* __nonnull createCompressedImage(char* __nonnull astcData, long blockWidth, long blockHeight, long blockDepth);
+    
+    /// Wraps `numRows` rows of slice `z` starting at row `y` without copying them. The rows stay owned by this image, which has to outlive the returned one.
+    ASTCRawImage* __nonnull createRowView(long z, long y, long numRows);
+    
 public:
     // TODO: Mark as initializer after Swift 6.2 release
     static ASTCRawImage* __nullable create(char* __nonnull data, long width, long height, long numComponents, long componentSize, bool linear, bool hdr, ASTCErrorInfo& error) SWIFT_NAME(__createUnsafe(_:width:height:numComponents:componentSize:linear:hdr:error:)) SWIFT_RETURNS_RETAINED;
     
-    ASTCImage* __nullable compress(long blockWidth, long blockHeight, float quality, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressUnsafe(blockWidth:blockHeight:quality:error:userInfo:progressCallback:)) SWIFT_RETURNS_RETAINED;
+    /// Creates an image from rows that are `bytesPerRow` bytes apart.
+    ///
+    /// Pass `0` as `bytesPerRow` for tightly packed rows.
+    static ASTCRawImage* __nullable create(char* __nonnull data, long width, long height, long bytesPerRow, long numComponents, long componentSize, bool linear, bool hdr, ASTCErrorInfo& error) SWIFT_NAME(__createUnsafe(_:width:height:bytesPerRow:numComponents:componentSize:linear:hdr:error:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Creates a 3D image from `depth` slices of `height` rows each.
+    ///
+    /// Rows are `bytesPerRow` bytes apart and slices follow each other without gaps. Pass `0` as `bytesPerRow` for tightly packed rows.
+    static ASTCRawImage* __nullable create(char* __nonnull data, long width, long height, long depth, long bytesPerRow, long numComponents, long componentSize, bool linear, bool hdr, ASTCErrorInfo& error) SWIFT_NAME(__createUnsafe(_:width:height:depth:bytesPerRow:numComponents:componentSize:linear:hdr:error:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Creates a tangent space normal map from a copy of `data`.
+    ///
+    /// The first two components hold X and Y mapped from `-1...1` to `0...1`, further components are ignored. Only X and Y are encoded, in the layout astcenc expects for normal maps, and decompression computes Z from them.
+    static ASTCRawImage* __nullable createNormalMap(char* __nonnull data, long width, long height, long bytesPerRow, long numComponents, long componentSize, ASTCErrorInfo& error) SWIFT_NAME(__createNormalMapUnsafe(_:width:height:bytesPerRow:numComponents:componentSize:error:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Creates an image that uses `data` directly instead of copying it.
+    ///
+    /// `data` must contain tightly packed 4 component pixels. `numComponents` tells how many of them carry actual image content. The image calls `releaseCallback` once it's destroyed; without a callback the caller must keep `data` alive for the lifetime of the image. If creation fails, the data is not released.
+    static ASTCRawImage* __nullable createWithoutCopy(char* __nonnull data, long width, long height, long numComponents, long componentSize, bool linear, bool hdr, void* __nullable releaseUserInfo, ASTCReleaseCallback __nullable releaseCallback, ASTCErrorInfo& error) SWIFT_NAME(__createWithoutCopyUnsafe(_:width:height:numComponents:componentSize:linear:hdr:releaseUserInfo:releaseCallback:error:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Compresses the image using `numThreads` threads.
+    ///
+    /// Pass `0` or a negative value as `numThreads` to use all available cores.
+    ASTCImage* __nullable compress(long blockWidth, long blockHeight, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressUnsafe(blockWidth:blockHeight:quality:numThreads:error:userInfo:progressCallback:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Compresses the image with 3D blocks using `numThreads` threads.
+    ///
+    /// The blocks of all slices are spread across the threads. 2D block sizes (`blockDepth` of `1`) compress every slice separately.
+    ASTCImage* __nullable compress(long blockWidth, long blockHeight, long blockDepth, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressUnsafe(blockWidth:blockHeight:blockDepth:quality:numThreads:error:userInfo:progressCallback:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Compresses the image with the given encoder settings using `numThreads` threads.
+    ASTCImage* __nullable compress(long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressUnsafe(blockWidth:blockHeight:blockDepth:options:numThreads:error:userInfo:progressCallback:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Size in bytes of the compressed image for the given block size, or `0` if the block size is invalid.
+    long getCompressedDataSize(long blockWidth, long blockHeight) { return getCompressedDataSize(blockWidth, blockHeight, 1); }
+    
+    /// Size in bytes of the compressed image for the given 3D block size, or `0` if the block size is invalid.
+    long getCompressedDataSize(long blockWidth, long blockHeight, long blockDepth);
+    
+    /// Number of levels of a full mipmap chain down to 1x1 pixels.
+    long getNumberOfMipmapLevels() SWIFT_COMPUTED_PROPERTY;
+    
+    /// Computes `numLevels` mipmap levels of the image and compresses all of them on `numThreads` threads.
+    ///
+    /// Pass `0` as `numLevels` for the full chain. Levels are filtered in linear space and handed to the encoder without creating intermediate images, all levels are then compressed side by side. The image itself becomes the first level.
+    ASTCTexture* __nullable compressMipmaps(long numLevels, ASTCMipmapFilter filter, long blockWidth, long blockHeight, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressMipmapsUnsafe(numLevels:filter:blockWidth:blockHeight:quality:numThreads:error:userInfo:progressCallback:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Computes `numLevels` mipmap levels of the image and compresses all of them with the given encoder settings.
+    ASTCTexture* __nullable compressMipmaps(long numLevels, ASTCMipmapFilter filter, long blockWidth, long blockHeight, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressMipmapsUnsafe(numLevels:filter:blockWidth:blockHeight:options:numThreads:error:userInfo:progressCallback:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Compresses the image into an `.astc` file at `path`.
+    ///
+    /// The file is sized up front and mapped into memory, so the encoder writes blocks straight into the file without an intermediate buffer.
+    bool compressToFile(const char* __nonnull path, long blockWidth, long blockHeight, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressToFileUnsafe(_:blockWidth:blockHeight:quality:numThreads:error:userInfo:progressCallback:));
+    
+    /// Compresses the image into an `.astc` file at `path` using 3D blocks of `blockDepth` slices.
+    bool compressToFile(const char* __nonnull path, long blockWidth, long blockHeight, long blockDepth, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressToFileUnsafe(_:blockWidth:blockHeight:blockDepth:quality:numThreads:error:userInfo:progressCallback:));
+    
+    /// Compresses the image into an `.astc` file at `path` with the given encoder settings.
+    bool compressToFile(const char* __nonnull path, long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressToFileUnsafe(_:blockWidth:blockHeight:blockDepth:options:numThreads:error:userInfo:progressCallback:));
+    
+    /// Compresses the image directly into caller-owned `buffer` using `numThreads` threads.
+    ///
+    /// `capacity` must be at least ``getCompressedDataSize(_:_:)`` bytes. Only that many bytes are written, the contents of `buffer` are undefined if compression fails.
+    bool compressInto(char* __nonnull buffer, long capacity, long blockWidth, long blockHeight, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressIntoUnsafe(_:capacity:blockWidth:blockHeight:quality:numThreads:error:userInfo:progressCallback:));
+    
+    /// Compresses the image with 3D blocks directly into caller-owned `buffer`.
+    bool compressInto(char* __nonnull buffer, long capacity, long blockWidth, long blockHeight, long blockDepth, float quality, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressIntoUnsafe(_:capacity:blockWidth:blockHeight:blockDepth:quality:numThreads:error:userInfo:progressCallback:));
+    
+    /// Compresses the image with the given encoder settings directly into caller-owned `buffer`.
+    bool compressInto(char* __nonnull buffer, long capacity, long blockWidth, long blockHeight, long blockDepth, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__compressIntoUnsafe(_:capacity:blockWidth:blockHeight:blockDepth:options:numThreads:error:userInfo:progressCallback:));
     
     /*const*/ char* __nonnull getData() SWIFT_RETURNS_INDEPENDENT_VALUE SWIFT_COMPUTED_PROPERTY { return _data; }
     
-    long getDataSize() SWIFT_COMPUTED_PROPERTY { return _width * _height * 4 * _componentSize; }
+    long getDataSize() SWIFT_COMPUTED_PROPERTY { return _width * _height * _depth * 4 * _componentSize; }
     
     long getWidth() SWIFT_COMPUTED_PROPERTY { return _width; }
     
     long getHeight() SWIFT_COMPUTED_PROPERTY { return _height; }
     
+    /// Number of slices, `1` for 2D images.
+    long getDepth() SWIFT_COMPUTED_PROPERTY { return _depth; }
+    
     long getComponentSize() SWIFT_COMPUTED_PROPERTY { return _componentSize; }
+    
+    /// Whether colour values are stored linearly instead of sRGB encoded.
+    bool getLinear() SWIFT_COMPUTED_PROPERTY { return _linear; }
+    
+    /// Whether colour values may exceed the `0...1` range. HDR images always have float components.
+    bool getHDR() SWIFT_COMPUTED_PROPERTY { return _hdr; }
+    
+    /// Whether the image was created with ``createNormalMap(_:_:_:_:_:_:_:)``.
+    bool getNormalMap() SWIFT_COMPUTED_PROPERTY { return _normalMap; }
 }
 SWIFT_SHARED_REFERENCE(ASTCRawImageRetain, ASTCRawImageRelease)
 SWIFT_UNCHECKED_SENDABLE;
@@ -101,6 +407,10 @@ private:
     const long _componentSize;
     const bool _linear;
     const bool _hdr;
+    // Compressed from a normal map, Z is reconstructed on decompression
+    bool _normalMap;
+    // Blocks the encoder skipped, empty for loaded images
+    ASTCBlockStatistics _blockStatistics;
     
     const long _numBlocksWidth;
     const long _numBlocksHeight;
@@ -110,18 +420,75 @@ private:
     const long _blockHeight;
     const long _blockDepth;
     
+    // Releases data the image doesn't own, like a file mapping. The data was allocated with `new []` if not set
+    void* __nullable _releaseUserInfo;
+    ASTCReleaseCallback __nullable _releaseCallback;
+    
     
     friend ASTCImage* __nullable ASTCImageRetain(ASTCImage* __nullable image) SWIFT_RETURNS_UNRETAINED;
     friend void ASTCImageRelease(ASTCImage* __nullable image);
     
     friend class ASTCRawImage;
+    friend class ASTCBatchEncoder;
+    friend class ASTCCompressionScheduler;
+    friend class ASTCTexture;
+    friend class ASTCCompressionCache;
     
     
-    ASTCImage(char* __nonnull data, long width, long height, long depth, long originalNumComponents, long componentSize, bool linear, bool hdr, long numBlocksWidth, long numBlocksHeight, long numBlocksDepth, long blockWidth, long blockHeight, long blockDepth);
+    ASTCImage(char* __nonnull data, long width, long height, long depth, long originalNumComponents, long componentSize, bool linear, bool hdr, long numBlocksWidth, long numBlocksHeight, long numBlocksDepth, long blockWidth, long blockHeight, long blockDepth, void* __nullable releaseUserInfo = nullptr, ASTCReleaseCallback __nullable releaseCallback = nullptr);
     ~ASTCImage();
     
+    /// Receives `numRows` decoded rows of slice `z` starting at row `y`. `pixels` points to the first requested pixel of the first row.
+    using DecodedRowsHandler = std::function<void(const char* __nonnull pixels, long bytesPerRow, long y, long z, long numRows)>;
+    
+    /// Decodes all block rows overlapping the given pixel rectangle strip by strip on `numThreads` threads, and hands the requested pixels of each strip to `handleRows`.
+    ///
+    /// The rectangle covers all slices of 3D images, a strip of 3D blocks is handed over slice by slice.
+    ///
+    /// Pixels are decoded as 4 components of `componentSize` bytes. `handleRows` is called from the worker threads.
+    ///
+    /// If `output` is set, the rectangle must span whole rows and strips are decoded in place into `output`, which holds tightly packed rows of the whole image. `handleRows` isn't called then.
+    ///
+    /// The progress callback can stop decoding between strips.
+    bool decodeBlockRows(long x, long y, long width, long height, long componentSize, char* __nullable output, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback, const DecodedRowsHandler& handleRows);
+    
 public:
-    ASTCRawImage* __nullable decompress(ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__decompressUnsafe(error:userInfo:progressCallback:)) SWIFT_RETURNS_RETAINED;
+    /// Loads an `.astc` file by mapping it into memory. The compressed blocks are used directly from the mapping without copying them.
+    ///
+    /// The `.astc` header only describes block and image dimensions, so the pixel format of the decompressed image is passed in the same way as for ``ASTCRawImage/create``.
+    static ASTCImage* __nullable load(const char* __nonnull path, long numComponents, long componentSize, bool linear, bool hdr, ASTCErrorInfo& error) SWIFT_NAME(__loadUnsafe(_:numComponents:componentSize:linear:hdr:error:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Writes the image as an `.astc` file. The header is followed by the compressed blocks written straight from the image.
+    bool write(const char* __nonnull path, ASTCErrorInfo& error) SWIFT_NAME(__writeUnsafe(_:error:));
+    
+    /// Decompresses the image using `numThreads` threads.
+    ///
+    /// Pass `0` or a negative value as `numThreads` to use all available cores.
+    ASTCRawImage* __nullable decompress(long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__decompressUnsafe(numThreads:error:userInfo:progressCallback:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Decompresses the image into `buffer` as 4 component pixels, writing rows `bytesPerRow` bytes apart.
+    ///
+    /// Pass `0` as `bytesPerRow` for tightly packed rows, which are decoded in place. Padded rows are decoded in strips of one block row and copied into `buffer`, so no full-size intermediate image is needed.
+    bool decompressInto(char* __nonnull buffer, long bytesPerRow, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__decompressIntoUnsafe(_:bytesPerRow:numThreads:error:userInfo:progressCallback:));
+    
+    /// Decompresses the image into `buffer` as pixels of `numComponents` components of `componentSize` bytes each.
+    ///
+    /// `numComponents` keeps the first components of the decoded pixels, `componentSize` selects 8 bit unorm (`1`), half float (`2`) or float (`4`) output. The conversion happens while decoding, tightly packed 4 component output is decoded in place and everything else strip by strip.
+    bool decompressInto(char* __nonnull buffer, long bytesPerRow, long numComponents, long componentSize, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__decompressIntoUnsafe(_:bytesPerRow:numComponents:componentSize:numThreads:error:userInfo:progressCallback:));
+    
+    /// Decompresses the pixels of `rect` into `buffer` as pixels of `numComponents` components of `componentSize` bytes each, writing rows `bytesPerRow` bytes apart.
+    ///
+    /// Only the blocks overlapping `rect` are decoded, so the time spent depends on the size of the region rather than the image. The first pixel of `rect` ends up at the start of `buffer`. The region covers all slices of 3D images, slices follow each other in `buffer`.
+    bool decompressRegionInto(const ASTCRect& rect, char* __nonnull buffer, long bytesPerRow, long numComponents, long componentSize, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__decompressRegionIntoUnsafe(_:buffer:bytesPerRow:numComponents:componentSize:numThreads:error:userInfo:progressCallback:));
+    
+    /// Re-encodes the blocks touched by `numRects` rectangles of `rects` from `image` and writes them over the compressed blocks in place. All other blocks stay untouched.
+    ///
+    /// `image` must have the size and pixel format of this image, and `options` should be the ones this image was compressed with. Rectangles cover all slices of 3D images, images with 3D blocks can't be updated.
+    ///
+    /// Only the touched blocks are passed to the encoder, so alpha scaling with a radius doesn't see the texels around them. The image must not be decoded while it's updated, and if the update fails some of the blocks may already be replaced.
+    ///
+    /// The blocks are changed in place, so the caller needs exclusive access to the image: textures and other holders of the image see the new blocks as well. Images mapped from a file or from a compression cache can't be updated, as their changes would silently diverge from the file. Block statistics describe a whole compression and are reset by an update.
+    bool update(ASTCRawImage* __nonnull image, const ASTCRect* __nonnull rects, long numRects, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__updateUnsafe(from:rects:numRects:options:numThreads:error:userInfo:progressCallback:));
     
     /// Number of components of decompressed image.
     ///
@@ -139,12 +506,34 @@ public:
     
     //long getComponentSize() SWIFT_COMPUTED_PROPERTY { return _componentSize; }
     
+    long getWidth() SWIFT_COMPUTED_PROPERTY { return _width; }
+    
+    long getHeight() SWIFT_COMPUTED_PROPERTY { return _height; }
+    
+    long getDepth() SWIFT_COMPUTED_PROPERTY { return _depth; }
+    
+    /// Whether the image was compressed from a normal map. Decompressed pixels then have Z computed from X and Y.
+    bool getNormalMap() SWIFT_COMPUTED_PROPERTY { return _normalMap; }
+    
+    /// Blocks that were written without a search of the encoder, when the image was compressed by this library. Empty after the image was updated.
+    ASTCBlockStatistics getBlockStatistics() SWIFT_COMPUTED_PROPERTY { return _blockStatistics; }
+    
+    /// Size of the compressed blocks in bytes.
+    long getDataSize() SWIFT_COMPUTED_PROPERTY { return _numBlocksWidth * _numBlocksHeight * _numBlocksDepth * 16; }
+    
     const char* __nonnull getData() SWIFT_RETURNS_INDEPENDENT_VALUE SWIFT_COMPUTED_PROPERTY { return _data; }
 }
 SWIFT_SHARED_REFERENCE(ASTCImageRetain, ASTCImageRelease)
 SWIFT_UNCHECKED_SENDABLE;
 
 
+#include <ASTCBatchEncoder.hpp>
+#include <ASTCCompressionScheduler.hpp>
+#include <ASTCTexture.hpp>
+#include <ASTCCompressionCache.hpp>
+#include <ASTCStreamEncoder.hpp>
+
+
 #endif // __cplusplus
 
 #endif // ASTCEncoderC_hpp
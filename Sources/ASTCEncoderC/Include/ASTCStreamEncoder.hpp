@@ -0,0 +1,76 @@
+//
+//  ASTCStreamEncoder.hpp
+//  ASTCEncoder
+//
+//  Created by agent on 16.10.26.
+//
+
+#ifndef ASTCStreamEncoder_hpp
+#define ASTCStreamEncoder_hpp
+
+#if defined __cplusplus
+
+#include <ASTCEncoderC.hpp>
+
+
+/// Reads `numRows` rows of the source image starting at row `y` into `buffer`, rows are `bytesPerRow` bytes apart. Returns `false` if the rows can't be read.
+typedef bool (* ASTCRowReader)(void* __nullable userInfo, char* __nonnull buffer, long bytesPerRow, long y, long numRows);
+
+/// Receives the compressed blocks of `numBlockRows` block rows starting at block row `blockY`, `dataLength` bytes of blocks in row-major order. Returns `false` to stop encoding.
+typedef bool (* ASTCBlockRowWriter)(void* __nullable userInfo, const char* __nonnull blocks, long dataLength, long blockY, long numBlockRows);
+
+
+/// Compresses images that don't fit into memory, strip by strip.
+///
+/// Rows of the source image are pulled from a reader in strips of whole block rows, and the compressed block rows are pushed to a writer as soon as they're done. Only two strips are in memory at a time: the next strip is read while the current one is encoded.
+///
+/// Block rows are encoded on their own, so the result matches compressing the whole image, except for alpha scaling with a radius, which doesn't see across strips.
+class ASTCStreamEncoder {
+private:
+    std::atomic<size_t> referenceCounter;
+    
+    const long _width;
+    const long _height;
+    const long _numComponents;
+    const long _componentSize;
+    const bool _linear;
+    const bool _hdr;
+    const long _blockWidth;
+    const long _blockHeight;
+    const ASTCCompressionOptions _options;
+    const long _numThreads;
+    const long _numStripBlockRows;
+    
+    
+    friend ASTCStreamEncoder* __nullable ASTCStreamEncoderRetain(ASTCStreamEncoder* __nullable encoder) SWIFT_RETURNS_UNRETAINED;
+    friend void ASTCStreamEncoderRelease(ASTCStreamEncoder* __nullable encoder);
+    
+    
+    ASTCStreamEncoder(long width, long height, long numComponents, long componentSize, bool linear, bool hdr, long blockWidth, long blockHeight, const ASTCCompressionOptions& options, long numThreads, long numStripBlockRows);
+    ~ASTCStreamEncoder();
+    
+public:
+    /// Creates an encoder for a `width` x `height` image with pixels in the same format as for ``ASTCRawImage/create``.
+    ///
+    /// Pass `0` or a negative value as `numThreads` to use all available cores.
+    static ASTCStreamEncoder* __nullable create(long width, long height, long numComponents, long componentSize, bool linear, bool hdr, long blockWidth, long blockHeight, const ASTCCompressionOptions& options, long numThreads, ASTCErrorInfo& error) SWIFT_NAME(__createUnsafe(width:height:numComponents:componentSize:linear:hdr:blockWidth:blockHeight:options:numThreads:error:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Compresses the image read by `reader` and hands the blocks to `writer` in order from top to bottom.
+    ///
+    /// `reader` and `writer` are called on the calling thread and get `streamUserInfo`. Progress is reported for the whole image.
+    bool encode(ASTCRowReader __nonnull reader, ASTCBlockRowWriter __nonnull writer, void* __nullable streamUserInfo, ASTCErrorInfo& error, void* __nullable userInfo, ASTCEncoderProgressCallback __nullable progressCallback) SWIFT_NAME(__encodeUnsafe(reader:writer:streamUserInfo:error:userInfo:progressCallback:));
+    
+    long getWidth() SWIFT_COMPUTED_PROPERTY { return _width; }
+    
+    long getHeight() SWIFT_COMPUTED_PROPERTY { return _height; }
+    
+    /// Number of pixel rows read and encoded at once. Strips are sized to keep all threads busy.
+    long getStripHeight() SWIFT_COMPUTED_PROPERTY { return _numStripBlockRows * _blockHeight; }
+}
+SWIFT_SHARED_REFERENCE(ASTCStreamEncoderRetain, ASTCStreamEncoderRelease)
+SWIFT_UNCHECKED_SENDABLE;
+
+
+#endif // __cplusplus
+
+#endif // ASTCStreamEncoder_hpp
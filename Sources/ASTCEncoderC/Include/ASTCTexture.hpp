@@ -0,0 +1,77 @@
+//
+//  ASTCTexture.hpp
+//  ASTCEncoder
+//
+//  Created by agent on 15.10.26.
+//
+
+#ifndef ASTCTexture_hpp
+#define ASTCTexture_hpp
+
+#if defined __cplusplus
+
+#include <ASTCEncoderC.hpp>
+
+
+/// Set of compressed images that make up a texture: mip levels, array layers and cube faces.
+///
+/// Textures are stored as KTX2 files. All images must share block size and color format, and each mip level is half the size of the previous one.
+class ASTCTexture {
+private:
+    std::atomic<size_t> referenceCounter;
+    
+    const long _numLevels;
+    const long _numLayers;
+    const long _numFaces;
+    
+    // Images ordered by level, then layer, then face
+    std::vector<ASTCImage*> _images;
+    
+    
+    friend ASTCTexture* __nullable ASTCTextureRetain(ASTCTexture* __nullable texture) SWIFT_RETURNS_UNRETAINED;
+    friend void ASTCTextureRelease(ASTCTexture* __nullable texture);
+    
+    
+    ASTCTexture(long numLevels, long numLayers, long numFaces);
+    ~ASTCTexture();
+    
+    long getImageIndex(long level, long layer, long face) { return (level * _numLayers + layer) * _numFaces + face; }
+    
+    /// Checks that all images are set and fit together.
+    bool validate(ASTCErrorInfo& error);
+    
+public:
+    /// Creates an empty texture.
+    ///
+    /// `numFaces` is `1` for regular textures and `6` for cube maps.
+    static ASTCTexture* __nullable create(long numLevels, long numLayers, long numFaces, ASTCErrorInfo& error) SWIFT_NAME(__createUnsafe(numLevels:numLayers:numFaces:error:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Loads a KTX2 file with ASTC contents by mapping it into memory. Images point into the mapping, no block data is copied.
+    ///
+    /// Block size and color format are taken from the file, `numComponents` and `componentSize` describe the decompressed images.
+    static ASTCTexture* __nullable load(const char* __nonnull path, long numComponents, long componentSize, ASTCErrorInfo& error) SWIFT_NAME(__loadUnsafe(_:numComponents:componentSize:error:)) SWIFT_RETURNS_RETAINED;
+    
+    long getNumberOfLevels() SWIFT_COMPUTED_PROPERTY { return _numLevels; }
+    
+    long getNumberOfLayers() SWIFT_COMPUTED_PROPERTY { return _numLayers; }
+    
+    long getNumberOfFaces() SWIFT_COMPUTED_PROPERTY { return _numFaces; }
+    
+    /// Sets the image of the given level, layer and face. Faces of cube maps must be square 2D images.
+    bool setImage(long level, long layer, long face, ASTCImage* __nonnull image, ASTCErrorInfo& error) SWIFT_NAME(__setImageUnsafe(_:level:layer:face:error:));
+    
+    /// Image of the given level, layer and face, if set.
+    ASTCImage* __nullable getImage(long level, long layer, long face) SWIFT_NAME(__getImageUnsafe(level:layer:face:)) SWIFT_RETURNS_RETAINED;
+    
+    /// Writes the texture as a KTX2 file.
+    ///
+    /// The file is written in one pass, block data goes straight from the images to the file.
+    bool write(const char* __nonnull path, ASTCErrorInfo& error) SWIFT_NAME(__writeUnsafe(_:error:));
+}
+SWIFT_SHARED_REFERENCE(ASTCTextureRetain, ASTCTextureRelease)
+SWIFT_UNCHECKED_SENDABLE;
+
+
+#endif // __cplusplus
+
+#endif // ASTCTexture_hpp
@@ -0,0 +1,113 @@
+//
+//  main.cpp
+//  ASTCExpansionBenchmark
+//
+//  Created by agent on 16.10.26.
+//
+
+#include "ASTCEncoderInternal.hpp"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// Bytes after the destination that the kernels must not touch
+#define ASTC_BENCHMARK_GUARD_SIZE 64
+#define ASTC_BENCHMARK_NUM_PIXELS (1024 * 1024)
+#define ASTC_BENCHMARK_NUM_RUNS 20
+
+
+typedef void (* ASTCComponentKernel)(const char* __nonnull src, char* __nonnull dst, long numPixels, long numComponents, long componentSize);
+
+
+/// Expansion as `ASTCRawImage` did it before the kernels: fill with `255` and copy pixel by pixel. Only right for 8 bit components, so it's timed but not compared.
+static void expandComponentsBaseline(const char* __nonnull src, char* __nonnull dst, long numPixels, long numComponents, long componentSize) {
+    auto pixelSize = numComponents * componentSize;
+    auto targetPixelSize = 4 * componentSize;
+    memset(dst, 255, numPixels * targetPixelSize);
+    for (long i = 0; i < numPixels; i++) {
+        memcpy(dst + i * targetPixelSize, src + i * pixelSize, pixelSize);
+    }
+}
+
+
+static void fillRandom(std::vector<char>& buffer) {
+    uint32_t state = 0x12345678;
+    for (auto& byte: buffer) {
+        state = state * 1664525 + 1013904223;
+        byte = static_cast<char>(state >> 24);
+    }
+}
+
+
+/// Runs `kernel` and `reference` over `numPixels` pixels and compares their output, including the guard bytes after it.
+static bool compareKernels(ASTCComponentKernel kernel, ASTCComponentKernel reference, long numPixels, long sourcePixelSize, long targetPixelSize, long numComponents, long componentSize) {
+    std::vector<char> source(numPixels * sourcePixelSize);
+    fillRandom(source);
+    
+    auto targetSize = numPixels * targetPixelSize + ASTC_BENCHMARK_GUARD_SIZE;
+    std::vector<char> target(targetSize, static_cast<char>(0xCD));
+    std::vector<char> expected(targetSize, static_cast<char>(0xCD));
+    kernel(source.data(), target.data(), numPixels, numComponents, componentSize);
+    reference(source.data(), expected.data(), numPixels, numComponents, componentSize);
+    return target == expected;
+}
+
+
+/// Pixels per second `kernel` processes, the best of several runs.
+static double measureKernel(ASTCComponentKernel kernel, const std::vector<char>& source, std::vector<char>& target, long numComponents, long componentSize) {
+    double bestSeconds = 0;
+    for (int run = 0; run < ASTC_BENCHMARK_NUM_RUNS; run++) {
+        auto start = std::chrono::steady_clock::now();
+        kernel(source.data(), target.data(), ASTC_BENCHMARK_NUM_PIXELS, numComponents, componentSize);
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        if (run == 0 || duration.count() < bestSeconds) {
+            bestSeconds = duration.count();
+        }
+    }
+    
+    return ASTC_BENCHMARK_NUM_PIXELS / bestSeconds;
+}
+
+
+int main() {
+    // Pixel counts around the vector widths exercise the tails the scalar implementation finishes
+    std::vector<long> pixelCounts;
+    for (long numPixels = 0; numPixels <= 67; numPixels++) {
+        pixelCounts.push_back(numPixels);
+    }
+    pixelCounts.push_back(4099);
+    
+    bool success = true;
+    printf("components  size  expand baseline  expand scalar  expand vector  pack scalar  pack vector  (Mpixels/s)\n");
+    for (long numComponents = 1; numComponents <= 3; numComponents++) {
+        for (long componentSize: {1L, 2L, 4L}) {
+            auto packedPixelSize = numComponents * componentSize;
+            auto expandedPixelSize = 4 * componentSize;
+            for (auto numPixels: pixelCounts) {
+                if (!compareKernels(expandComponents, expandComponentsScalar, numPixels, packedPixelSize, expandedPixelSize, numComponents, componentSize)) {
+                    printf("Expansion of %ld pixels with %ld components of %ld bytes differs from the scalar implementation\n", numPixels, numComponents, componentSize);
+                    success = false;
+                }
+                if (!compareKernels(packComponents, packComponentsScalar, numPixels, expandedPixelSize, packedPixelSize, numComponents, componentSize)) {
+                    printf("Packing of %ld pixels with %ld components of %ld bytes differs from the scalar implementation\n", numPixels, numComponents, componentSize);
+                    success = false;
+                }
+            }
+            
+            std::vector<char> packed(ASTC_BENCHMARK_NUM_PIXELS * packedPixelSize);
+            std::vector<char> expanded(ASTC_BENCHMARK_NUM_PIXELS * expandedPixelSize);
+            fillRandom(packed);
+            fillRandom(expanded);
+            auto expandBaseline = measureKernel(expandComponentsBaseline, packed, expanded, numComponents, componentSize);
+            auto expandScalar = measureKernel(expandComponentsScalar, packed, expanded, numComponents, componentSize);
+            auto expandVector = measureKernel(expandComponents, packed, expanded, numComponents, componentSize);
+            auto packScalar = measureKernel(packComponentsScalar, expanded, packed, numComponents, componentSize);
+            auto packVector = measureKernel(packComponents, expanded, packed, numComponents, componentSize);
+            printf("%10ld  %4ld  %15.1f  %13.1f  %13.1f  %11.1f  %11.1f\n", numComponents, componentSize,
+                   expandBaseline / 1e6, expandScalar / 1e6, expandVector / 1e6, packScalar / 1e6, packVector / 1e6);
+        }
+    }
+    
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}